@@ -1,32 +1,47 @@
 #include "app.h"
 
-App::App()
+App::App(std::chrono::milliseconds tick)
   : timer_(ioctx_)
-  , ttm_{600, 60, 24}
+  , tick_(std::max(tick, std::chrono::milliseconds{1}))
+  // the first wheel spans a minute, the others minutes and hours
+  , ttm_{static_cast<size_t>(
+           std::max<int64_t>(std::chrono::minutes{1} / tick_, 1)),
+      60, 24}
+  , wake_pending_(false)
 {
 }
 
+App::~App()
+{
+  while (MpscNode* node = posted_.Pop())
+  {
+    static_cast<AppTask*>(node)->Drop();
+  }
+}
+
 void App::Start()
 {
-  timer_.expires_from_now(TickPeriod{1});
-  timer_.async_wait([this](const std::error_code& ec) { OnTimer(); });
+  // re-arming cancels the wait left over from an earlier run
+  timer_.expires_from_now(tick_);
+  timer_.async_wait([this](const std::error_code& ec) {
+    if (!ec)
+    {
+      OnTimer();
+    }
+  });
   ioctx_.run();
 }
 
 TickTimerID App::AddPeriodTimer(
-  std::chrono::seconds interval, const TickTimerCallback& callback)
+  std::chrono::milliseconds interval, const TickTimerCallback& callback)
 {
-  uint32_t interval_tick = std::max<uint32_t>(interval / TickPeriod{1}, 1);
-  interval_tick = std::min<size_t>(interval_tick, ttm_.MaxTimerTicks());
-  return ttm_.AddPeriodTimer(interval_tick, callback);
+  return ttm_.AddPeriodTimer(ToTicks(interval), callback);
 }
 
 TickTimerID App::AddOneshotTimer(
-  std::chrono::seconds delay, const TickTimerCallback& callback)
+  std::chrono::milliseconds delay, const TickTimerCallback& callback)
 {
-  uint32_t delay_tick = std::max<uint32_t>(delay / TickPeriod{1}, 1);
-  delay_tick = std::min<size_t>(delay_tick, ttm_.MaxTimerTicks());
-  return ttm_.AddOneshotTimer(delay_tick, callback);
+  return ttm_.AddOneshotTimer(ToTicks(delay), callback);
 }
 
 void App::RemoveTimer(TickTimerID timer_id)
@@ -34,10 +49,67 @@ void App::RemoveTimer(TickTimerID timer_id)
   ttm_.RemoveTimer(timer_id);
 }
 
+HostResolver& App::Resolver()
+{
+  if (!resolver_)
+  {
+    resolver_ = std::make_unique<HostResolver>(ioctx_);
+  }
+  return *resolver_;
+}
+
+void App::Post(AppTask* task)
+{
+  posted_.Push(task);
+  Wake();
+}
+
+void App::Wake()
+{
+  // one wake-up for everything posted until RunPosted starts draining
+  if (!wake_pending_.exchange(true, std::memory_order_acq_rel))
+  {
+    asio::post(ioctx_, [this] { RunPosted(); });
+  }
+}
+
+void App::RunPosted()
+{
+  // tasks pushed from now on need another wake-up; a push still halfway
+  // through when Pop gives up is followed by that wake-up
+  wake_pending_.exchange(false, std::memory_order_acq_rel);
+
+  for (size_t n = 0; n < POST_BATCH; ++n)
+  {
+    MpscNode* node = posted_.Pop();
+    if (node == nullptr)
+    {
+      return;
+    }
+    static_cast<AppTask*>(node)->Run();
+  }
+
+  // leave the loop to other handlers before the next batch
+  Wake();
+}
+
+uint32_t App::ToTicks(std::chrono::milliseconds duration) const
+{
+  int64_t ticks = (duration + tick_ - std::chrono::milliseconds{1}) / tick_;
+  ticks = std::max<int64_t>(ticks, 1);
+  ticks = std::min<int64_t>(ticks, ttm_.MaxTimerTicks());
+  return static_cast<uint32_t>(ticks);
+}
+
 void App::OnTimer()
 {
   ttm_.RunTick();
 
-  timer_.expires_at(timer_.expiry() + TickPeriod{1});
-  timer_.async_wait([this](const std::error_code& ec) { OnTimer(); });
+  timer_.expires_at(timer_.expiry() + tick_);
+  timer_.async_wait([this](const std::error_code& ec) {
+    if (!ec)
+    {
+      OnTimer();
+    }
+  });
 }
@@ -1,30 +1,113 @@
 #pragma once
 
+#include <atomic>
 #include <chrono>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include "buffer_pool.h"
+#include "host_resolver.h"
+#include "mpsc_queue.h"
 #include "thirtyparty/asio/asio.hpp"
 #include "tick_timer.h"
 
+// Work handed to an App from another thread. Derive from it to post
+// without an allocation: the App does not touch a task again after calling
+// Run, or Drop for tasks still queued when it is destroyed.
+class AppTask : public MpscNode
+{
+public:
+  virtual void Run() = 0;
+  virtual void Drop() {}
+
+protected:
+  ~AppTask() = default;
+};
+
 class App
 {
 public:
-  App();
+  // Timers fire on tick boundaries; a finer tick gives sub-second timers
+  // (e.g. request hedging) at the cost of more wake-ups.
+  explicit App(std::chrono::milliseconds tick = std::chrono::milliseconds{100});
+  ~App();
+  // Run the loop until Stop. Once Start returned it may run again after
+  // IoCtx().restart(); a Stop that comes before Start makes it return at
+  // once.
   void Start();
+  // Make Start return; callable from any thread.
+  void Stop() { ioctx_.stop(); }
 
+  // Intervals are rounded up to whole ticks and capped at one day.
   TickTimerID AddPeriodTimer(
-    std::chrono::seconds interval, const TickTimerCallback& callback);
+    std::chrono::milliseconds interval, const TickTimerCallback& callback);
   TickTimerID AddOneshotTimer(
-    std::chrono::seconds delay, const TickTimerCallback& callback);
+    std::chrono::milliseconds delay, const TickTimerCallback& callback);
   void RemoveTimer(TickTimerID timer_id);
 
+  std::chrono::milliseconds Tick() const { return tick_; }
   asio::io_context& IoCtx() { return ioctx_; }
+  // Shared by everything on this App, so lookups are cached across
+  // clients.
+  HostResolver& Resolver();
+  // Read buffers borrowed by connections while data is arriving.
+  BufferPool& Buffers() { return buffers_; }
+
+  // Run a task on this App's thread; callable from any thread. Tasks go
+  // through a lock-free queue, and a single wake-up of the loop runs every
+  // task queued until then, POST_BATCH at a time between other handlers.
+  void Post(AppTask* task);
+  template <typename F,
+    typename = std::enable_if_t<!std::is_convertible_v<F, AppTask*>>>
+  void Post(F&& fn);
 
 private:
+  enum
+  {
+    POST_BATCH = 256
+  };
+
+  template <typename F>
+  struct FunctionTask final : public AppTask
+  {
+    explicit FunctionTask(F&& f)
+      : fn(std::move(f))
+    {
+    }
+    explicit FunctionTask(const F& f)
+      : fn(f)
+    {
+    }
+    void Run() override
+    {
+      fn();
+      delete this;
+    }
+    void Drop() override { delete this; }
+
+    F fn;
+  };
+
+  void Wake();
+  void RunPosted();
   void OnTimer();
+  uint32_t ToTicks(std::chrono::milliseconds duration) const;
 
 private:
+  // declared first: handlers destroyed with ioctx_ may still hold buffers
+  BufferPool buffers_;
   asio::io_context ioctx_;
   asio::steady_timer timer_;
+  std::chrono::milliseconds tick_;
   TickTimerManager ttm_;
-  using TickPeriod =
-    std::chrono::duration<long long, std::deci>;  // 1/10 second
+  std::unique_ptr<HostResolver> resolver_;
+  MpscQueue posted_;
+  // a RunPosted is queued on ioctx_ and has not started draining yet
+  std::atomic<bool> wake_pending_;
 };
+
+template <typename F, typename>
+void App::Post(F&& fn)
+{
+  Post(new FunctionTask<std::decay_t<F>>(std::forward<F>(fn)));
+}
@@ -0,0 +1,117 @@
+#include "app_shards.h"
+#include <algorithm>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+#include "hash_ring.h"
+
+static thread_local size_t t_shard = AppShards::npos;
+
+AppShards::AppShards(const AppShardsOptions& options)
+  : options_(options)
+  , running_(false)
+{
+  size_t count = options_.shards;
+  if (count == 0)
+  {
+    count = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+  }
+
+  shards_.resize(count);
+  for (auto& shard : shards_)
+  {
+    shard.app = std::make_unique<App>(options_.tick);
+  }
+}
+
+AppShards::~AppShards()
+{
+  Stop();
+}
+
+size_t AppShards::ShardOf(std::string_view key) const
+{
+  // same hash tag, same shard, as on a HashRing
+  return HashRing::Hash(HashRing::HashTag(key)) % shards_.size();
+}
+
+size_t AppShards::CurrentIndex()
+{
+  return t_shard;
+}
+
+void AppShards::Post(size_t shard, std::function<void()> fn)
+{
+  shards_[shard].app->Post(std::move(fn));
+}
+
+void AppShards::PostAll(const std::function<void(App&)>& fn)
+{
+  for (auto& shard : shards_)
+  {
+    App* app = shard.app.get();
+    app->Post([app, fn] { fn(*app); });
+  }
+}
+
+void AppShards::Start()
+{
+  if (running_)
+  {
+    return;
+  }
+
+  running_ = true;
+  for (size_t i = 0; i < shards_.size(); ++i)
+  {
+    // undo an earlier Stop here, before the thread exists, so a Stop that
+    // follows at once is not lost
+    shards_[i].app->IoCtx().restart();
+    shards_[i].thread = std::thread(&AppShards::Run, this, i);
+  }
+}
+
+void AppShards::Stop()
+{
+  if (!running_)
+  {
+    return;
+  }
+
+  for (auto& shard : shards_)
+  {
+    shard.app->Stop();
+  }
+  for (auto& shard : shards_)
+  {
+    shard.thread.join();
+  }
+  running_ = false;
+}
+
+void AppShards::Run(size_t index)
+{
+  t_shard = index;
+  if (options_.pin_threads)
+  {
+    size_t cpus = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    size_t cpu = index % cpus;
+#ifdef _WIN32
+    // an affinity mask covers one processor group of up to 64 CPUs
+    if (cpu < sizeof(DWORD_PTR) * 8)
+    {
+      SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR{1} << cpu);
+    }
+#else
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+  }
+
+  shards_[index].app->Start();
+}
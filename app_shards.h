@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cassert>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "app.h"
+
+struct AppShardsOptions
+{
+  // 0 for one per hardware thread
+  size_t shards = 0;
+  std::chrono::milliseconds tick{100};
+  // pin the thread of shard i to CPU i, modulo the CPU count
+  bool pin_threads = true;
+};
+
+// Thread-per-core mode. Each shard is a complete App, with its own
+// io_context, timer wheels, resolver and buffer pool, run by its own
+// thread. Objects built on a shard's App (RedisClient, ...) belong to that
+// shard and are only used from its thread, so nothing is shared between
+// threads in the hot path; other threads hand them work with Post.
+//
+// Callbacks and CallbackHost lifetime tracking are not thread-safe: a
+// callback must be invoked on the shard of the object that made it.
+class AppShards
+{
+public:
+  static constexpr size_t npos = static_cast<size_t>(-1);
+
+  explicit AppShards(const AppShardsOptions& options = AppShardsOptions{});
+  // Stops and joins the threads.
+  ~AppShards();
+
+  size_t Size() const { return shards_.size(); }
+  App& Shard(size_t index) { return *shards_[index].app; }
+  // The shard a key is pinned to; stable for a given number of shards.
+  size_t ShardOf(std::string_view key) const;
+
+  // Shard of the calling thread, npos outside the shards.
+  static size_t CurrentIndex();
+
+  // Run fn on the thread of a shard, through App::Post. Callable from any
+  // thread; tasks posted to one shard run in order.
+  void Post(size_t shard, std::function<void()> fn);
+  void PostAll(const std::function<void(App&)>& fn);
+
+  // Run every shard on its own thread and return; again after Stop.
+  void Start();
+  // Stop the loops and join their threads; pending tasks do not run.
+  void Stop();
+  bool Running() const { return running_; }
+
+private:
+  struct ShardState
+  {
+    std::unique_ptr<App> app;
+    std::thread thread;
+  };
+
+  void Run(size_t index);
+
+private:
+  AppShardsOptions options_;
+  std::vector<ShardState> shards_;
+  bool running_;
+};
+
+// One T per shard, each used and destroyed on its own shard's thread, e.g.
+// a RedisClient per shard:
+//
+//   PerShard<RedisClient> clients(shards, [](App& app) {
+//     return std::make_unique<RedisClient>(app, ...);
+//   });
+//   shards.Post(i, [&] { clients.Local().Command(...); });
+//
+// Build and destroy from outside the shards. While they run, each instance
+// is built on its shard's thread and both the constructor and the
+// destructor wait for the shards; otherwise it is done on the calling
+// thread, before any shard thread can see the instances.
+template <typename T>
+class PerShard
+{
+public:
+  using Factory = std::function<std::unique_ptr<T>(App&)>;
+
+  PerShard(AppShards& shards, const Factory& factory)
+    : shards_(shards)
+    , objects_(shards.Size())
+  {
+    if (!shards_.Running())
+    {
+      for (size_t i = 0; i < shards_.Size(); ++i)
+      {
+        objects_[i] = factory(shards_.Shard(i));
+      }
+      return;
+    }
+
+    OnEachShard([this, &factory](size_t i) {
+      objects_[i] = factory(shards_.Shard(i));
+    });
+  }
+
+  ~PerShard()
+  {
+    if (shards_.Running())
+    {
+      OnEachShard([this](size_t i) { objects_[i].reset(); });
+    }
+  }
+
+  PerShard(const PerShard&) = delete;
+  PerShard& operator=(const PerShard&) = delete;
+
+  // The calling shard's instance; only on a shard thread.
+  T& Local()
+  {
+    size_t index = AppShards::CurrentIndex();
+    assert(index != AppShards::npos && objects_[index]);
+    return *objects_[index];
+  }
+  // Another shard's instance, to be used on that shard only.
+  T& At(size_t shard)
+  {
+    assert(objects_[shard]);
+    return *objects_[shard];
+  }
+
+private:
+  // Run fn(i) on every shard i and wait for all of them.
+  template <typename F>
+  void OnEachShard(const F& fn)
+  {
+    std::vector<std::future<void>> done;
+    for (size_t i = 0; i < shards_.Size(); ++i)
+    {
+      auto finished = std::make_shared<std::promise<void>>();
+      done.push_back(finished->get_future());
+      shards_.Post(i, [&fn, i, finished] {
+        fn(i);
+        finished->set_value();
+      });
+    }
+    for (auto& future : done)
+    {
+      future.wait();
+    }
+  }
+
+private:
+  AppShards& shards_;
+  std::vector<std::unique_ptr<T>> objects_;
+};
@@ -0,0 +1,124 @@
+#include "buffer_pool.h"
+#include <algorithm>
+
+//////////////////////////////////////////////////////////////////////////////
+// PooledBuffer
+PooledBuffer::PooledBuffer(PooledBuffer&& other) noexcept
+  : pool_(other.pool_)
+  , data_(other.data_)
+  , size_(other.size_)
+{
+  other.pool_ = nullptr;
+  other.data_ = nullptr;
+  other.size_ = 0;
+}
+
+PooledBuffer& PooledBuffer::operator=(PooledBuffer&& other) noexcept
+{
+  if (this != &other)
+  {
+    Release();
+    pool_ = other.pool_;
+    data_ = other.data_;
+    size_ = other.size_;
+    other.pool_ = nullptr;
+    other.data_ = nullptr;
+    other.size_ = 0;
+  }
+  return *this;
+}
+
+void PooledBuffer::Release()
+{
+  if (data_ == nullptr)
+  {
+    return;
+  }
+
+  pool_->Release(data_, size_);
+  pool_ = nullptr;
+  data_ = nullptr;
+  size_ = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// BufferPool
+BufferPool::BufferPool(const BufferPoolOptions& options)
+  : options_(options)
+{
+  // round min_size up to a power of two so every class is one
+  size_t min_size = 1;
+  while (min_size < options_.min_size)
+  {
+    min_size <<= 1;
+  }
+  options_.min_size = min_size;
+  options_.max_size = std::max(options_.max_size, min_size);
+
+  free_.resize(ClassOf(options_.max_size) + 1);
+  options_.max_size = options_.min_size << (free_.size() - 1);
+}
+
+PooledBuffer BufferPool::Acquire(size_t size)
+{
+  if (size > options_.max_size)
+  {
+    return PooledBuffer();
+  }
+
+  size_t cls = ClassOf(size);
+  size_t class_size = options_.min_size << cls;
+  ++stats_.acquires;
+  ++stats_.in_use;
+  stats_.in_use_bytes += class_size;
+  stats_.peak_in_use_bytes =
+    std::max(stats_.peak_in_use_bytes, stats_.in_use_bytes);
+
+  auto& free = free_[cls];
+  if (free.empty())
+  {
+    ++stats_.allocations;
+    return PooledBuffer(this, new char[class_size], class_size);
+  }
+
+  char* data = free.back().release();
+  free.pop_back();
+  --stats_.cached;
+  stats_.cached_bytes -= class_size;
+  return PooledBuffer(this, data, class_size);
+}
+
+void BufferPool::Trim()
+{
+  for (auto& free : free_)
+  {
+    free.clear();
+  }
+  stats_.cached = 0;
+  stats_.cached_bytes = 0;
+}
+
+void BufferPool::Release(char* data, size_t size)
+{
+  --stats_.in_use;
+  stats_.in_use_bytes -= size;
+  if (stats_.cached_bytes + size > options_.max_cached_bytes)
+  {
+    delete[] data;
+    return;
+  }
+
+  free_[ClassOf(size)].emplace_back(data);
+  ++stats_.cached;
+  stats_.cached_bytes += size;
+}
+
+size_t BufferPool::ClassOf(size_t size) const
+{
+  size_t cls = 0;
+  while ((options_.min_size << cls) < size)
+  {
+    ++cls;
+  }
+  return cls;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+struct BufferPoolOptions
+{
+  // size classes are the powers of two from min_size to max_size
+  size_t min_size = 4 * 1024;
+  size_t max_size = 1024 * 1024;
+  // released buffers beyond this are freed instead of kept for reuse
+  size_t max_cached_bytes = 16 * 1024 * 1024;
+};
+
+struct BufferPoolStats
+{
+  uint64_t acquires = 0;
+  // acquires not served from the cache
+  uint64_t allocations = 0;
+  size_t in_use = 0;
+  size_t in_use_bytes = 0;
+  size_t peak_in_use_bytes = 0;
+  size_t cached = 0;
+  size_t cached_bytes = 0;
+};
+
+class BufferPool;
+
+// A buffer borrowed from a BufferPool, given back when released or
+// destroyed. Move-only; the pool must outlive it.
+class PooledBuffer
+{
+public:
+  PooledBuffer() = default;
+  PooledBuffer(PooledBuffer&& other) noexcept;
+  PooledBuffer& operator=(PooledBuffer&& other) noexcept;
+  PooledBuffer(const PooledBuffer&) = delete;
+  PooledBuffer& operator=(const PooledBuffer&) = delete;
+  ~PooledBuffer() { Release(); }
+
+  char* Data() const { return data_; }
+  size_t Size() const { return size_; }
+  explicit operator bool() const { return data_ != nullptr; }
+
+  void Release();
+
+private:
+  friend class BufferPool;
+  PooledBuffer(BufferPool* pool, char* data, size_t size)
+    : pool_(pool)
+    , data_(data)
+    , size_(size)
+  {
+  }
+
+  BufferPool* pool_ = nullptr;
+  char* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+// Size-class cache of I/O buffers, so connections hold memory only while
+// they need it instead of each owning a worst-case buffer. Single-threaded,
+// like the App that owns it.
+class BufferPool
+{
+public:
+  explicit BufferPool(const BufferPoolOptions& options = BufferPoolOptions{});
+  BufferPool(const BufferPool&) = delete;
+  BufferPool& operator=(const BufferPool&) = delete;
+
+  // A buffer of the smallest class holding size bytes; empty if size is
+  // above max_size.
+  PooledBuffer Acquire(size_t size);
+  // Free every cached buffer.
+  void Trim();
+
+  size_t MaxSize() const { return options_.max_size; }
+  BufferPoolStats Stats() const { return stats_; }
+
+private:
+  friend class PooledBuffer;
+  void Release(char* data, size_t size);
+  size_t ClassOf(size_t size) const;
+
+private:
+  BufferPoolOptions options_;
+  // free buffers by size class
+  std::vector<std::vector<std::unique_ptr<char[]>>> free_;
+  BufferPoolStats stats_;
+};
@@ -2,7 +2,7 @@
 
 using namespace async::detail;
 
-async::CallbackHost* CoFrameBase::host = nullptr;
+thread_local async::CallbackHost* CoFrameBase::host = nullptr;
 
 CoFrameBase::CoFrameBase()
 {
@@ -75,7 +75,8 @@ protected:
   CoFrameBase* prev_frame_ = nullptr;
 
 private:
-  static async::CallbackHost* host;
+  // per thread, as coroutines are created on every App shard's thread
+  static thread_local async::CallbackHost* host;
 };
 
 struct FinalAwaitable
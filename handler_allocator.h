@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Memory for the asio operation of one outstanding async call. An
+// operation is freed before its handler runs, so a connection that keeps
+// one read and one write in flight reuses the same two blocks forever
+// instead of allocating per I/O. Bigger or overlapping requests fall back
+// to the heap.
+template <size_t Size = 256>
+class HandlerMemory
+{
+public:
+  HandlerMemory() = default;
+  HandlerMemory(const HandlerMemory&) = delete;
+  HandlerMemory& operator=(const HandlerMemory&) = delete;
+
+  void* Allocate(size_t size)
+  {
+    if (!in_use_ && size <= sizeof(storage_))
+    {
+      in_use_ = true;
+      return &storage_;
+    }
+    ++fallbacks_;
+    return ::operator new(size);
+  }
+
+  void Deallocate(void* ptr)
+  {
+    if (ptr == &storage_)
+    {
+      in_use_ = false;
+      return;
+    }
+    ::operator delete(ptr);
+  }
+
+  // allocations that did not fit the block
+  size_t Fallbacks() const { return fallbacks_; }
+
+private:
+  typename std::aligned_storage<Size>::type storage_;
+  bool in_use_ = false;
+  size_t fallbacks_ = 0;
+};
+
+// Standard allocator over a HandlerMemory, what asio uses for the
+// operations of a handler whose associated allocator it is.
+template <typename T, size_t Size = 256>
+class HandlerAllocator
+{
+public:
+  using value_type = T;
+  template <typename U>
+  struct rebind
+  {
+    using other = HandlerAllocator<U, Size>;
+  };
+
+  explicit HandlerAllocator(HandlerMemory<Size>& memory)
+    : memory_(&memory)
+  {
+  }
+  template <typename U>
+  HandlerAllocator(const HandlerAllocator<U, Size>& other) noexcept
+    : memory_(other.memory_)
+  {
+  }
+
+  T* allocate(size_t n)
+  {
+    return static_cast<T*>(memory_->Allocate(sizeof(T) * n));
+  }
+  void deallocate(T* ptr, size_t) { memory_->Deallocate(ptr); }
+
+  template <typename U>
+  bool operator==(const HandlerAllocator<U, Size>& other) const noexcept
+  {
+    return memory_ == other.memory_;
+  }
+  template <typename U>
+  bool operator!=(const HandlerAllocator<U, Size>& other) const noexcept
+  {
+    return memory_ != other.memory_;
+  }
+
+private:
+  template <typename, size_t>
+  friend class HandlerAllocator;
+
+  HandlerMemory<Size>* memory_;
+};
+
+// Wraps a completion handler so that asio allocates its operation from
+// memory, through the associated allocator.
+template <typename Handler, size_t Size = 256>
+class AllocHandler
+{
+public:
+  using allocator_type = HandlerAllocator<Handler, Size>;
+
+  AllocHandler(HandlerMemory<Size>& memory, Handler handler)
+    : memory_(memory)
+    , handler_(std::move(handler))
+  {
+  }
+
+  allocator_type get_allocator() const noexcept
+  {
+    return allocator_type(memory_);
+  }
+
+  template <typename... Args>
+  void operator()(Args&&... args)
+  {
+    handler_(std::forward<Args>(args)...);
+  }
+
+private:
+  HandlerMemory<Size>& memory_;
+  Handler handler_;
+};
+
+template <typename Handler, size_t Size>
+AllocHandler<typename std::decay<Handler>::type, Size> MakeAllocHandler(
+  HandlerMemory<Size>& memory, Handler&& handler)
+{
+  return AllocHandler<typename std::decay<Handler>::type, Size>(
+    memory, std::forward<Handler>(handler));
+}
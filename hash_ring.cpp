@@ -0,0 +1,112 @@
+#include "hash_ring.h"
+#include <algorithm>
+
+HashRing::HashRing(size_t points_per_weight)
+  : points_per_weight_(std::max<size_t>(points_per_weight, 1))
+{
+}
+
+size_t HashRing::Set(std::string_view name, uint32_t weight)
+{
+  size_t slot = Find(name);
+  if (slot == nodes_.size())
+  {
+    nodes_.push_back(Node{std::string(name), 0});
+  }
+
+  if (nodes_[slot].weight != weight)
+  {
+    nodes_[slot].weight = weight;
+    Rebuild();
+  }
+  return slot;
+}
+
+size_t HashRing::Find(std::string_view name) const
+{
+  auto it = std::find_if(nodes_.begin(), nodes_.end(),
+    [name](const Node& node) { return node.name == name; });
+  return static_cast<size_t>(it - nodes_.begin());
+}
+
+void HashRing::Rebuild()
+{
+  points_.clear();
+  std::string label;
+  for (size_t slot = 0; slot < nodes_.size(); ++slot)
+  {
+    const Node& node = nodes_[slot];
+    uint32_t owner = static_cast<uint32_t>(slot);
+    size_t count = points_per_weight_ * node.weight;
+    // two points per hash, as ketama takes four from each md5 digest
+    for (size_t i = 0; i < count; i += 2)
+    {
+      label = node.name;
+      label += '-';
+      label += std::to_string(i / 2);
+      uint64_t hash = Hash(label);
+      points_.push_back({static_cast<uint32_t>(hash), owner});
+      if (i + 1 < count)
+      {
+        points_.push_back({static_cast<uint32_t>(hash >> 32), owner});
+      }
+    }
+  }
+
+  // ties go to the lower node name, so the owner of a point does not
+  // depend on the order nodes were added in, as slots do
+  std::sort(points_.begin(), points_.end(),
+    [this](const Point& a, const Point& b) {
+      if (a.hash != b.hash)
+      {
+        return a.hash < b.hash;
+      }
+      return nodes_[a.slot].name < nodes_[b.slot].name;
+    });
+}
+
+size_t HashRing::Locate(std::string_view key) const
+{
+  uint32_t hash = static_cast<uint32_t>(Hash(HashTag(key)));
+  auto it = std::lower_bound(points_.begin(), points_.end(), hash,
+    [](const Point& point, uint32_t hash) { return point.hash < hash; });
+  if (it == points_.end())
+  {
+    it = points_.begin();
+  }
+  return it->slot;
+}
+
+uint64_t HashRing::Hash(std::string_view data)
+{
+  // FNV-1a, then the murmur3 finalizer to spread short similar inputs
+  uint64_t hash = 14695981039346656037ull;
+  for (unsigned char c : data)
+  {
+    hash ^= c;
+    hash *= 1099511628211ull;
+  }
+
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdull;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53ull;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+std::string_view HashRing::HashTag(std::string_view key)
+{
+  size_t open = key.find('{');
+  if (open == std::string_view::npos)
+  {
+    return key;
+  }
+
+  size_t close = key.find('}', open + 1);
+  if (close == std::string_view::npos || close == open + 1)
+  {
+    return key;
+  }
+  return key.substr(open + 1, close - open - 1);
+}
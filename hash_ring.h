@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Ketama-style consistent hash ring. Every node owns points_per_weight
+// points per unit of weight, placed by hashing "<name>-<index>", and a key
+// belongs to the node owning the first point at or after the key's hash.
+// A node's points depend only on its name, so adding, removing or
+// reweighting a node only moves the keys that node gains or loses. The
+// points are kept in one sorted table; a lookup is a binary search.
+class HashRing
+{
+public:
+  explicit HashRing(size_t points_per_weight = 160);
+
+  // Add a node or change its weight, rebuilding the table. Returns the
+  // node's slot, stable for the ring's lifetime; weight 0 keeps the slot
+  // but takes the node off the ring.
+  size_t Set(std::string_view name, uint32_t weight);
+  void Remove(std::string_view name) { Set(name, 0); }
+  // Slot of a node, Slots() if there is none.
+  size_t Find(std::string_view name) const;
+
+  bool Empty() const { return points_.empty(); }
+  // Slot of the node a key belongs to; the ring must not be empty. As in
+  // Redis Cluster, only the part between the first { and the } after it is
+  // hashed, so keys sharing a hash tag share a node; the whole key is
+  // hashed if that part is empty or unclosed.
+  size_t Locate(std::string_view key) const;
+
+  size_t Slots() const { return nodes_.size(); }
+  const std::string& Name(size_t slot) const { return nodes_[slot].name; }
+  uint32_t Weight(size_t slot) const { return nodes_[slot].weight; }
+
+  static uint64_t Hash(std::string_view data);
+  static std::string_view HashTag(std::string_view key);
+
+private:
+  struct Node
+  {
+    std::string name;
+    uint32_t weight = 0;
+  };
+
+  struct Point
+  {
+    uint32_t hash;
+    uint32_t slot;
+  };
+
+  void Rebuild();
+
+private:
+  size_t points_per_weight_;
+  std::vector<Node> nodes_;
+  std::vector<Point> points_;
+};
@@ -0,0 +1,144 @@
+#include "host_resolver.h"
+#include <algorithm>
+#include <charconv>
+
+HostResolver::HostResolver(asio::io_context& ioctx, std::chrono::seconds ttl)
+  : resolver_(ioctx)
+  , ttl_(ttl)
+{
+}
+
+void HostResolver::Resolve(
+  std::string_view host, uint16_t port, const ResolveCallback& cb_resolve)
+{
+  std::error_code ec;
+  auto address = asio::ip::make_address(std::string(host), ec);
+  if (!ec)
+  {
+    cb_resolve.Invoke(ec,
+      std::vector<asio::ip::tcp::endpoint>{
+        asio::ip::tcp::endpoint(address, port)});
+    return;
+  }
+
+  std::string key(host);
+  key.push_back(':');
+  key.append(std::to_string(port));
+  Entry& entry = cache_[key];
+  if (!entry.resolving && !entry.endpoints.empty() &&
+      std::chrono::steady_clock::now() < entry.expires)
+  {
+    cb_resolve.Invoke(std::error_code(), entry.endpoints);
+    return;
+  }
+
+  entry.waiters.push_back(cb_resolve);
+  if (entry.resolving)
+  {
+    return;
+  }
+
+  entry.resolving = true;
+  resolver_.async_resolve(std::string(host), std::to_string(port),
+    [cb = async::Bind<void(const std::error_code&,
+       asio::ip::tcp::resolver::results_type)>(
+       &HostResolver::OnResolved, this, key)](const std::error_code& ec,
+      asio::ip::tcp::resolver::results_type results) {
+      cb.Invoke(ec, std::move(results));
+    });
+}
+
+void HostResolver::Clear()
+{
+  for (auto it = cache_.begin(); it != cache_.end();)
+  {
+    if (it->second.resolving)
+    {
+      ++it;
+    }
+    else
+    {
+      it = cache_.erase(it);
+    }
+  }
+}
+
+void HostResolver::OnResolved(std::string key, const std::error_code& ec,
+  asio::ip::tcp::resolver::results_type results)
+{
+  Entry& entry = cache_[key];
+  entry.resolving = false;
+  entry.endpoints.clear();
+
+  // alternate families, keeping the resolver's order within each
+  std::vector<asio::ip::tcp::endpoint> first, second;
+  for (const auto& result : results)
+  {
+    auto endpoint = result.endpoint();
+    bool same = first.empty() ||
+                first.front().address().is_v6() == endpoint.address().is_v6();
+    (same ? first : second).push_back(endpoint);
+  }
+  for (size_t i = 0; i < std::max(first.size(), second.size()); ++i)
+  {
+    if (i < first.size())
+    {
+      entry.endpoints.push_back(first[i]);
+    }
+    if (i < second.size())
+    {
+      entry.endpoints.push_back(second[i]);
+    }
+  }
+  entry.expires = std::chrono::steady_clock::now() + ttl_;
+
+  std::error_code error = ec;
+  if (!error && entry.endpoints.empty())
+  {
+    error = asio::error::host_not_found;
+  }
+
+  // waiters may resolve again, which can rehash the cache
+  auto waiters = std::move(entry.waiters);
+  auto endpoints = entry.endpoints;
+  entry.waiters.clear();
+  if (error)
+  {
+    cache_.erase(key);
+  }
+
+  for (const auto& waiter : waiters)
+  {
+    waiter.Invoke(error, endpoints);
+  }
+}
+
+bool HostResolver::SplitHostPort(
+  std::string_view address, std::string_view& host, uint16_t& port)
+{
+  size_t colon = address.rfind(':');
+  if (colon == std::string_view::npos)
+  {
+    return false;
+  }
+
+  std::string_view name = address.substr(0, colon);
+  if (name.size() >= 2 && name.front() == '[' && name.back() == ']')
+  {
+    name = name.substr(1, name.size() - 2);
+  }
+
+  std::string_view digits = address.substr(colon + 1);
+  uint16_t number = 0;
+  auto [ptr, ec] =
+    std::from_chars(digits.data(), digits.data() + digits.size(), number);
+  if (name.empty() || ec != std::errc() ||
+      ptr != digits.data() + digits.size())
+  {
+    return false;
+  }
+
+  host = name;
+  port = number;
+  return true;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+#include "callback.h"
+#include "thirtyparty/asio/asio.hpp"
+
+using ResolveCallback = async::Callback<void(
+  const std::error_code&, const std::vector<asio::ip::tcp::endpoint>&)>;
+
+// Asynchronous host name resolution with a TTL cache. Concurrent lookups of
+// the same host:port share one query. Addresses are ordered for connection
+// racing: families alternate, starting with the first one returned (RFC
+// 8305). Numeric addresses are answered without a query.
+class HostResolver : public async::CallbackHost
+{
+public:
+  explicit HostResolver(asio::io_context& ioctx,
+    std::chrono::seconds ttl = std::chrono::seconds{60});
+
+  // The callback may run before Resolve returns, on a cache hit.
+  void Resolve(
+    std::string_view host, uint16_t port, const ResolveCallback& cb_resolve);
+  // Drop the cached addresses; lookups in flight still answer their
+  // callers.
+  void Clear();
+
+  // Split "host:port" or "[v6 address]:port"; false, leaving host and
+  // port untouched, if malformed.
+  static bool SplitHostPort(
+    std::string_view address, std::string_view& host, uint16_t& port);
+
+private:
+  struct Entry
+  {
+    std::vector<asio::ip::tcp::endpoint> endpoints;
+    std::chrono::steady_clock::time_point expires;
+    // callers waiting for the query in flight
+    std::vector<ResolveCallback> waiters;
+    bool resolving = false;
+  };
+
+  void OnResolved(std::string key, const std::error_code& ec,
+    asio::ip::tcp::resolver::results_type results);
+
+private:
+  asio::ip::tcp::resolver resolver_;
+  std::chrono::seconds ttl_;
+  // by "host:port"
+  std::unordered_map<std::string, Entry> cache_;
+};
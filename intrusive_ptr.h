@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+
+// Base of objects whose lifetime is shared by handlers of one event loop
+// thread. Unlike std::shared_ptr the count is a plain integer: copying an
+// IntrusivePtr costs no atomic operation, and there is no control block.
+class RefCounted
+{
+public:
+  RefCounted(const RefCounted&) = delete;
+  RefCounted& operator=(const RefCounted&) = delete;
+
+  void AddRef() { ++refs_; }
+  void Release()
+  {
+    if (--refs_ == 0)
+    {
+      delete this;
+    }
+  }
+
+protected:
+  RefCounted() = default;
+  virtual ~RefCounted() = default;
+
+private:
+  size_t refs_ = 0;
+};
+
+template <typename T>
+class IntrusivePtr
+{
+public:
+  IntrusivePtr() = default;
+  // Takes a reference, so it may be built from this, as from
+  // shared_from_this().
+  explicit IntrusivePtr(T* ptr)
+    : ptr_(ptr)
+  {
+    if (ptr_)
+    {
+      ptr_->AddRef();
+    }
+  }
+  IntrusivePtr(const IntrusivePtr& other)
+    : IntrusivePtr(other.ptr_)
+  {
+  }
+  IntrusivePtr(IntrusivePtr&& other) noexcept
+    : ptr_(std::exchange(other.ptr_, nullptr))
+  {
+  }
+  template <typename U>
+  IntrusivePtr(const IntrusivePtr<U>& other)
+    : IntrusivePtr(other.get())
+  {
+  }
+  ~IntrusivePtr()
+  {
+    if (ptr_)
+    {
+      ptr_->Release();
+    }
+  }
+
+  IntrusivePtr& operator=(IntrusivePtr other) noexcept
+  {
+    std::swap(ptr_, other.ptr_);
+    return *this;
+  }
+
+  void reset() { IntrusivePtr().swap(*this); }
+  void swap(IntrusivePtr& other) noexcept { std::swap(ptr_, other.ptr_); }
+
+  T* get() const { return ptr_; }
+  T& operator*() const { return *ptr_; }
+  T* operator->() const { return ptr_; }
+  explicit operator bool() const { return ptr_ != nullptr; }
+
+private:
+  T* ptr_ = nullptr;
+};
+
+template <typename T, typename U>
+bool operator==(const IntrusivePtr<T>& a, const IntrusivePtr<U>& b)
+{
+  return a.get() == b.get();
+}
+
+template <typename T, typename U>
+bool operator!=(const IntrusivePtr<T>& a, const IntrusivePtr<U>& b)
+{
+  return a.get() != b.get();
+}
+
+template <typename T, typename... Args>
+IntrusivePtr<T> MakeIntrusive(Args&&... args)
+{
+  return IntrusivePtr<T>(new T(std::forward<Args>(args)...));
+}
@@ -0,0 +1,251 @@
+#include "lane_redis_client.h"
+#include <algorithm>
+#include "redis_command.h"
+
+LaneRedisClient::LaneRedisClient(App& app, const LaneOptions& options)
+  : app_(app)
+  , options_(options)
+  , next_blocking_id_(0)
+  , trim_scheduled_(false)
+{
+  options_.max_blocking = std::max<size_t>(options_.max_blocking, 1);
+  default_ = std::make_unique<RedisClient>(app_,
+    async::Bind<void(int)>(
+      &LaneRedisClient::OnLaneConnected, this, RedisLane::kDefault),
+    async::Bind<void()>(
+      &LaneRedisClient::OnLaneDisconnect, this, RedisLane::kDefault),
+    options_.pipeline);
+  priority_ = std::make_unique<RedisClient>(app_,
+    async::Bind<void(int)>(
+      &LaneRedisClient::OnLaneConnected, this, RedisLane::kPriority),
+    async::Bind<void()>(
+      &LaneRedisClient::OnLaneDisconnect, this, RedisLane::kPriority),
+    options_.priority_pipeline);
+}
+
+LaneRedisClient::~LaneRedisClient()
+{
+  // fail pending commands while the rest of the client is still alive
+  default_.reset();
+  priority_.reset();
+  auto blocking = std::move(blocking_);
+  blocking.clear();
+}
+
+void LaneRedisClient::Connect(const asio::ip::tcp::endpoint& server)
+{
+  server_ = server;
+  default_->Connect(server);
+  priority_->Connect(server);
+  // blocking connections are opened on demand, to the new server from now
+  for (auto& conn : blocking_)
+  {
+    conn.retired = true;
+  }
+  ScheduleTrim();
+}
+
+bool LaneRedisClient::IsBlocking(const std::vector<RedisArg>& args)
+{
+  const RedisCommandInfo* info =
+    args.empty() ? nullptr : LookupRedisCommand(args[0].data);
+  if (info == nullptr || !(info->flags & kRedisCmdBlocking))
+  {
+    return false;
+  }
+
+  std::vector<std::string_view> views;
+  views.reserve(args.size());
+  for (const auto& arg : args)
+  {
+    views.push_back(arg.data);
+  }
+  return RedisCommandBlocks(*info, views);
+}
+
+void LaneRedisClient::Command(const std::vector<RedisArg>& args,
+  const CommandCallback& cb_cmd, RedisLane lane)
+{
+  if (lane != RedisLane::kBlocking && IsBlocking(args))
+  {
+    lane = RedisLane::kBlocking;
+  }
+  ++stats_.lanes[static_cast<size_t>(lane)].commands;
+
+  if (lane != RedisLane::kBlocking)
+  {
+    Client(lane).Command(args, cb_cmd);
+    return;
+  }
+
+  BlockingConnection& conn = AcquireBlocking();
+  ++conn.pending;
+  conn.client->Command(args,
+    async::Bind<void(const ZResult<RedisMessage>&)>(
+      &LaneRedisClient::OnBlockingReply, this, conn.id, cb_cmd));
+}
+
+RedisClient& LaneRedisClient::Client(RedisLane lane)
+{
+  return lane == RedisLane::kPriority ? *priority_ : *default_;
+}
+
+LaneRedisClientStats LaneRedisClient::Stats() const
+{
+  LaneRedisClientStats stats = stats_;
+  auto add = [](LaneStats& lane, const RedisClient& client) {
+    auto client_stats = client.Stats();
+    ++lane.connections;
+    lane.queued += client_stats.queued;
+    lane.inflight += client_stats.inflight;
+  };
+
+  add(stats.lanes[static_cast<size_t>(RedisLane::kDefault)], *default_);
+  add(stats.lanes[static_cast<size_t>(RedisLane::kPriority)], *priority_);
+  for (const auto& conn : blocking_)
+  {
+    add(stats.lanes[static_cast<size_t>(RedisLane::kBlocking)], *conn.client);
+  }
+  return stats;
+}
+
+// An idle connection if there is one, else a new one while under
+// max_blocking, else the one with the fewest pending commands.
+LaneRedisClient::BlockingConnection& LaneRedisClient::AcquireBlocking()
+{
+  BlockingConnection* best = nullptr;
+  size_t open = 0;
+  for (auto& conn : blocking_)
+  {
+    if (conn.broken || conn.retired)
+    {
+      continue;
+    }
+
+    ++open;
+    if (best == nullptr || conn.pending < best->pending)
+    {
+      best = &conn;
+    }
+  }
+
+  if (best && (best->pending == 0 || open >= options_.max_blocking))
+  {
+    return *best;
+  }
+
+  uint64_t id = ++next_blocking_id_;
+  auto& conn = blocking_.emplace_back();
+  conn.id = id;
+  conn.client = std::make_unique<RedisClient>(app_,
+    async::Bind<void(int)>(&LaneRedisClient::OnBlockingConnected, this, id),
+    async::Bind<void()>(&LaneRedisClient::OnBlockingDisconnect, this, id),
+    options_.pipeline);
+  conn.client->Connect(server_);
+  return conn;
+}
+
+LaneRedisClient::BlockingConnection* LaneRedisClient::FindBlocking(
+  uint64_t id)
+{
+  auto it = std::find_if(blocking_.begin(), blocking_.end(),
+    [id](const BlockingConnection& conn) { return conn.id == id; });
+  return it == blocking_.end() ? nullptr : &*it;
+}
+
+void LaneRedisClient::OnBlockingReply(uint64_t id,
+  const CommandCallback& cb_cmd, const ZResult<RedisMessage>& reply)
+{
+  // a trimmed connection fails its commands after leaving blocking_
+  BlockingConnection* conn = FindBlocking(id);
+  if (conn && --conn->pending == 0)
+  {
+    ScheduleTrim();
+  }
+  cb_cmd.Invoke(reply);
+}
+
+void LaneRedisClient::OnBlockingConnected(uint64_t id, int error)
+{
+  if (error)
+  {
+    OnBlockingDisconnect(id);
+  }
+}
+
+void LaneRedisClient::OnBlockingDisconnect(uint64_t id)
+{
+  // not reconnected: commands still queued on it fail when it is trimmed,
+  // and new ones get a fresh connection
+  BlockingConnection* conn = FindBlocking(id);
+  if (conn)
+  {
+    conn->broken = true;
+    ScheduleTrim();
+  }
+}
+
+// A connection cannot be destroyed from its own callbacks; trimming runs
+// after the handler.
+void LaneRedisClient::ScheduleTrim()
+{
+  if (trim_scheduled_)
+  {
+    return;
+  }
+
+  trim_scheduled_ = true;
+  asio::post(app_.IoCtx(),
+    [trim = async::Bind<void()>(&LaneRedisClient::TrimBlocking, this)] {
+      trim.Invoke();
+    });
+}
+
+void LaneRedisClient::TrimBlocking()
+{
+  trim_scheduled_ = false;
+
+  std::vector<BlockingConnection> closing;
+  size_t idle = 0;
+  for (auto it = blocking_.begin(); it != blocking_.end();)
+  {
+    bool close = it->broken;
+    if (!close && it->pending == 0)
+    {
+      close = it->retired || ++idle > options_.max_idle_blocking;
+    }
+
+    if (close)
+    {
+      closing.push_back(std::move(*it));
+      it = blocking_.erase(it);
+    }
+    else
+    {
+      ++it;
+    }
+  }
+  // fails whatever is still queued on the closed connections
+  closing.clear();
+}
+
+void LaneRedisClient::OnLaneConnected(RedisLane lane, int error)
+{
+  if (error)
+  {
+    OnLaneDisconnect(lane);
+  }
+}
+
+void LaneRedisClient::OnLaneDisconnect(RedisLane lane)
+{
+  // pending commands already failed; retry the connection shortly
+  app_.AddOneshotTimer(std::chrono::seconds{1},
+    async::Bind<void(TickTimerID)>(
+      &LaneRedisClient::OnReconnectTimer, this, lane));
+}
+
+void LaneRedisClient::OnReconnectTimer(RedisLane lane, TickTimerID timer_id)
+{
+  Client(lane).Connect(server_);
+}
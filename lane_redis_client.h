@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "app.h"
+#include "callback.h"
+#include "redis_client.h"
+#include "thirtyparty/asio/asio.hpp"
+
+enum class RedisLane
+{
+  kDefault,
+  // interactive commands that must not wait behind bulk traffic
+  kPriority,
+  // one connection per blocked command
+  kBlocking,
+};
+
+struct LaneOptions
+{
+  PipelineOptions pipeline;
+  PipelineOptions priority_pipeline;
+  // Blocking connections open at most. Beyond that a blocking command
+  // queues behind the connection with the fewest pending commands.
+  size_t max_blocking = 32;
+  // idle blocking connections kept open for reuse
+  size_t max_idle_blocking = 2;
+};
+
+struct LaneStats
+{
+  uint64_t commands = 0;
+  size_t connections = 0;
+  // summed over the lane's connections, see RedisClientStats
+  size_t queued = 0;
+  size_t inflight = 0;
+};
+
+struct LaneRedisClientStats
+{
+  LaneStats lanes[3];
+};
+
+// Client keeping classes of commands on separate connections, each with its
+// own queue, so they cannot stall each other. Commands go to the default
+// lane unless the caller picks the priority lane. Commands that can block
+// (BLPOP, BRPOPLPUSH, WAIT, XREAD with BLOCK, ...) always go to the
+// blocking lane, which opens connections lazily and gives each blocked
+// command one of its own.
+class LaneRedisClient : public async::CallbackHost
+{
+public:
+  LaneRedisClient(App& app, const LaneOptions& options = LaneOptions{});
+  ~LaneRedisClient();
+
+  void Connect(const asio::ip::tcp::endpoint& server);
+
+  void Command(const std::vector<RedisArg>& args, const CommandCallback& cb_cmd,
+    RedisLane lane = RedisLane::kDefault);
+
+  // The default or priority lane's client, for its other APIs.
+  RedisClient& Client(RedisLane lane);
+
+  LaneRedisClientStats Stats() const;
+
+  // Whether the command can block the connection it is sent on.
+  static bool IsBlocking(const std::vector<RedisArg>& args);
+
+private:
+  struct BlockingConnection
+  {
+    uint64_t id = 0;
+    std::unique_ptr<RedisClient> client;
+    size_t pending = 0;
+    bool broken = false;
+    // connected to the server before the last Connect: finishes its
+    // pending commands, then is closed
+    bool retired = false;
+  };
+
+  BlockingConnection& AcquireBlocking();
+  BlockingConnection* FindBlocking(uint64_t id);
+  void OnBlockingReply(uint64_t id, const CommandCallback& cb_cmd,
+    const ZResult<RedisMessage>& reply);
+  void OnBlockingConnected(uint64_t id, int error);
+  void OnBlockingDisconnect(uint64_t id);
+  void ScheduleTrim();
+  void TrimBlocking();
+
+  void OnLaneConnected(RedisLane lane, int error);
+  void OnLaneDisconnect(RedisLane lane);
+  void OnReconnectTimer(RedisLane lane, TickTimerID timer_id);
+
+private:
+  App& app_;
+  LaneOptions options_;
+  asio::ip::tcp::endpoint server_;
+  std::unique_ptr<RedisClient> default_;
+  std::unique_ptr<RedisClient> priority_;
+  std::vector<BlockingConnection> blocking_;
+  uint64_t next_blocking_id_;
+  bool trim_scheduled_;
+  LaneRedisClientStats stats_;
+};
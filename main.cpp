@@ -1,9 +1,13 @@
+#include <cstdlib>
 #include <ctime>
 #include <iostream>
 #include "app.h"
 #include "callback.h"
 #include "cotask.h"
+#include "host_resolver.h"
 #include "redis_client.h"
+#include "redis_proxy.h"
+#include "redis_server.h"
 #include "resp_codec.h"
 #include "result.h"
 
@@ -232,6 +236,34 @@ private:
   RedisClient* client_;
 };
 
+void TestRedisProxy(App& app)
+{
+  RedisProxyOptions options;
+  options.listen = asio::ip::tcp::endpoint(asio::ip::tcp::v4(), 6380);
+  options.upstream =
+    asio::ip::tcp::endpoint(asio::ip::address::from_string("10.0.2.30"), 6379);
+  static RedisProxy proxy(app, options);
+  proxy.Start();
+}
+
+async::CoTask<RedisMessage> OnTime(RedisServerRequest request)
+{
+  co_return RedisMessage{std::in_place_index<0>, RedisInteger(time(nullptr))};
+}
+
+void TestRedisServer(App& app)
+{
+  static RedisServer server(
+    app, asio::ip::tcp::endpoint(asio::ip::tcp::v4(), 6381));
+  server.RegisterCommand("HELLO", 1,
+    RedisCommandHandler([](const RedisServerRequest& request) {
+      request.Reply(RedisMessage{
+        std::in_place_index<1>, RedisString{std::string("world")}});
+    }));
+  server.RegisterCoCommand("TIME", 1, OnTime);
+  server.Start();
+}
+
 int main()
 {
   App app;
@@ -241,8 +273,14 @@ int main()
   auto cb2 = async::Bind<void()>(&RedisClientConsole::OnDisconnect, &console);
   RedisClient client(app, cb1, cb2);
   console.SetRedisClient(&client);
-  client.Connect(
-    asio::ip::tcp::endpoint(asio::ip::address::from_string("10.0.2.30"), 6379));
+  // resolved asynchronously once the loop runs
+  std::string_view host = "10.0.2.30";
+  uint16_t port = 6379;
+  if (const char* address = std::getenv("REDIS_ADDRESS"))
+  {
+    HostResolver::SplitHostPort(address, host, port);
+  }
+  client.Connect(host, port);
 
   app.Start();
 
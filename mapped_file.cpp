@@ -0,0 +1,231 @@
+#include "mapped_file.h"
+#include <algorithm>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+  Close();
+}
+
+#ifdef _WIN32
+bool MappedFile::Open(const std::string& path, size_t size)
+{
+  Close();
+
+  HANDLE file = ::CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE,
+    FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+  {
+    return false;
+  }
+
+  LARGE_INTEGER file_size;
+  if (!::GetFileSizeEx(file, &file_size))
+  {
+    ::CloseHandle(file);
+    return false;
+  }
+
+  // the mapping extends the file when size is larger, allocating the space
+  // or failing when the disk is full
+  size = std::max<size_t>(size, static_cast<size_t>(file_size.QuadPart));
+  HANDLE mapping = ::CreateFileMappingA(file, nullptr, PAGE_READWRITE,
+    static_cast<DWORD>(static_cast<uint64_t>(size) >> 32),
+    static_cast<DWORD>(size & 0xffffffff), nullptr);
+  if (mapping == nullptr)
+  {
+    ::CloseHandle(file);
+    return false;
+  }
+
+  void* data = ::MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+  if (data == nullptr)
+  {
+    ::CloseHandle(mapping);
+    ::CloseHandle(file);
+    return false;
+  }
+
+  path_ = path;
+  file_ = file;
+  mapping_ = mapping;
+  data_ = static_cast<char*>(data);
+  size_ = size;
+  return true;
+}
+
+bool MappedFile::OpenReadOnly(const std::string& path)
+{
+  Close();
+
+  HANDLE file = ::CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+    nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+  {
+    return false;
+  }
+
+  LARGE_INTEGER file_size;
+  if (!::GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+  {
+    ::CloseHandle(file);
+    return false;
+  }
+
+  HANDLE mapping =
+    ::CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (mapping == nullptr)
+  {
+    ::CloseHandle(file);
+    return false;
+  }
+
+  void* data = ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (data == nullptr)
+  {
+    ::CloseHandle(mapping);
+    ::CloseHandle(file);
+    return false;
+  }
+
+  path_ = path;
+  file_ = file;
+  mapping_ = mapping;
+  data_ = static_cast<char*>(data);
+  size_ = static_cast<size_t>(file_size.QuadPart);
+  return true;
+}
+
+void MappedFile::Close()
+{
+  if (data_)
+  {
+    ::UnmapViewOfFile(data_);
+    ::CloseHandle(mapping_);
+    ::CloseHandle(file_);
+  }
+
+  data_ = nullptr;
+  size_ = 0;
+  mapping_ = nullptr;
+  file_ = nullptr;
+}
+
+bool MappedFile::Sync()
+{
+  if (!data_)
+  {
+    return false;
+  }
+
+  return ::FlushViewOfFile(data_, size_) && ::FlushFileBuffers(file_);
+}
+#else
+bool MappedFile::Open(const std::string& path, size_t size)
+{
+  Close();
+
+  int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd < 0)
+  {
+    return false;
+  }
+
+  struct stat st;
+  if (::fstat(fd, &st) != 0)
+  {
+    ::close(fd);
+    return false;
+  }
+
+  // allocate the blocks now: with a sparse file a full disk would show up
+  // as SIGBUS on a store through the mapping
+  if (static_cast<size_t>(st.st_size) < size &&
+      ::posix_fallocate(fd, 0, static_cast<off_t>(size)) != 0)
+  {
+    ::close(fd);
+    if (st.st_size == 0)
+    {
+      ::unlink(path.c_str());
+    }
+    return false;
+  }
+
+  size = std::max<size_t>(size, static_cast<size_t>(st.st_size));
+  void* data =
+    ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (data == MAP_FAILED)
+  {
+    ::close(fd);
+    return false;
+  }
+
+  path_ = path;
+  fd_ = fd;
+  data_ = static_cast<char*>(data);
+  size_ = size;
+  return true;
+}
+
+bool MappedFile::OpenReadOnly(const std::string& path)
+{
+  Close();
+
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    return false;
+  }
+
+  struct stat st;
+  if (::fstat(fd, &st) != 0 || st.st_size == 0)
+  {
+    ::close(fd);
+    return false;
+  }
+
+  size_t size = static_cast<size_t>(st.st_size);
+  void* data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (data == MAP_FAILED)
+  {
+    ::close(fd);
+    return false;
+  }
+
+  path_ = path;
+  fd_ = fd;
+  data_ = static_cast<char*>(data);
+  size_ = size;
+  return true;
+}
+
+void MappedFile::Close()
+{
+  if (data_)
+  {
+    ::munmap(data_, size_);
+    ::close(fd_);
+  }
+
+  data_ = nullptr;
+  size_ = 0;
+  fd_ = -1;
+}
+
+bool MappedFile::Sync()
+{
+  if (!data_)
+  {
+    return false;
+  }
+
+  return ::msync(data_, size_, MS_SYNC) == 0;
+}
+#endif
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// A file mapped into memory. Open maps it read-write and grows it to the
+// requested size; the new tail reads as zeros. The disk space is allocated
+// by Open, which fails when it is not available, so stores through Data()
+// cannot run out of it later.
+class MappedFile
+{
+public:
+  MappedFile() = default;
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  bool Open(const std::string& path, size_t size);
+  // Map an existing file as it is; Data() must not be written to.
+  bool OpenReadOnly(const std::string& path);
+  void Close();
+  // Write dirty pages back to disk and wait for completion.
+  bool Sync();
+
+  bool IsOpen() const { return data_ != nullptr; }
+  char* Data() const { return data_; }
+  size_t Size() const { return size_; }
+  const std::string& Path() const { return path_; }
+
+private:
+  std::string path_;
+  char* data_ = nullptr;
+  size_t size_ = 0;
+#ifdef _WIN32
+  void* file_ = nullptr;
+  void* mapping_ = nullptr;
+#else
+  int fd_ = -1;
+#endif
+};
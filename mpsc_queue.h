@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+
+struct MpscNode
+{
+  std::atomic<MpscNode*> next{nullptr};
+};
+
+// Intrusive lock-free multi-producer single-consumer FIFO (Vyukov). Push
+// is one atomic exchange and never blocks or allocates; Pop belongs to one
+// consumer thread. The queue does not own its nodes.
+class MpscQueue
+{
+public:
+  MpscQueue()
+    : head_(&stub_)
+    , tail_(&stub_)
+  {
+  }
+  MpscQueue(const MpscQueue&) = delete;
+  MpscQueue& operator=(const MpscQueue&) = delete;
+
+  // Any thread.
+  void Push(MpscNode* node)
+  {
+    node->next.store(nullptr, std::memory_order_relaxed);
+    MpscNode* prev = head_.exchange(node, std::memory_order_acq_rel);
+    prev->next.store(node, std::memory_order_release);
+  }
+
+  // Consumer only. nullptr when empty, and also while the next node's push
+  // is halfway through; that producer has not returned from Push yet.
+  MpscNode* Pop()
+  {
+    MpscNode* tail = tail_;
+    MpscNode* next = tail->next.load(std::memory_order_acquire);
+    if (tail == &stub_)
+    {
+      if (next == nullptr)
+      {
+        return nullptr;
+      }
+      tail_ = next;
+      tail = next;
+      next = next->next.load(std::memory_order_acquire);
+    }
+
+    if (next)
+    {
+      tail_ = next;
+      return tail;
+    }
+
+    if (tail != head_.load(std::memory_order_acquire))
+    {
+      return nullptr;
+    }
+
+    // tail is the last node: put the stub behind it so it can be unlinked
+    Push(&stub_);
+    next = tail->next.load(std::memory_order_acquire);
+    if (next)
+    {
+      tail_ = next;
+      return tail;
+    }
+    return nullptr;
+  }
+
+private:
+  // producers and the consumer on separate cache lines
+  alignas(64) std::atomic<MpscNode*> head_;
+  alignas(64) MpscNode* tail_;
+  MpscNode stub_;
+};
@@ -0,0 +1,64 @@
+#include "pipeline_window.h"
+#include <algorithm>
+
+PipelineWindow::PipelineWindow(const PipelineOptions& options)
+  : options_(options)
+  , srtt_(0)
+  , min_rtt_(Duration::max())
+  , epoch_min_rtt_(Duration::max())
+  , replies_(0)
+  , recover_until_(0)
+  , window_limited_(false)
+{
+  options_.min_depth = std::max<size_t>(options_.min_depth, 1);
+  options_.max_depth = std::max(options_.max_depth, options_.min_depth);
+  options_.min_rtt_epoch = std::max<uint32_t>(options_.min_rtt_epoch, 1);
+  cwnd_ = static_cast<double>(options_.min_depth);
+}
+
+void PipelineWindow::OnReply(Duration latency, size_t inflight)
+{
+  ++replies_;
+
+  // srtt = 7/8 srtt + 1/8 sample
+  srtt_ = srtt_.count() == 0 ? latency : (srtt_ * 7 + latency) / 8;
+
+  min_rtt_ = std::min(min_rtt_, latency);
+  epoch_min_rtt_ = std::min(epoch_min_rtt_, latency);
+  if (replies_ % options_.min_rtt_epoch == 0)
+  {
+    min_rtt_ = epoch_min_rtt_;
+    epoch_min_rtt_ = Duration::max();
+  }
+
+  auto threshold = min_rtt_ + Duration(static_cast<Duration::rep>(
+                                min_rtt_.count() * options_.delay_tolerance));
+  if (latency > threshold)
+  {
+    Decrease(inflight);
+  }
+  else if (window_limited_)
+  {
+    Increase();
+  }
+}
+
+void PipelineWindow::Increase()
+{
+  // +1 per window of replies
+  cwnd_ += 1.0 / cwnd_;
+  cwnd_ = std::min(cwnd_, static_cast<double>(options_.max_depth));
+}
+
+void PipelineWindow::Decrease(size_t inflight)
+{
+  if (replies_ < recover_until_)
+  {
+    // already backed off in this round trip
+    return;
+  }
+
+  cwnd_ = std::max(cwnd_ / 2, static_cast<double>(options_.min_depth));
+  // replies to commands already in flight still carry the old queueing delay
+  recover_until_ = replies_ + inflight;
+}
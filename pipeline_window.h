@@ -0,0 +1,54 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+struct PipelineOptions
+{
+  size_t min_depth = 1;
+  size_t max_depth = 256;
+  // A reply slower than min_rtt * (1 + delay_tolerance) is taken as a sign
+  // of queueing at the server and shrinks the window.
+  double delay_tolerance = 1.0;
+  // The minimum RTT is re-learned every this many replies, so a base line
+  // observed on an idle server does not stick forever.
+  uint32_t min_rtt_epoch = 4096;
+};
+
+// Delay-based AIMD controller for the number of in-flight commands.
+// The window grows by one per window of fast replies while it is the limit,
+// and halves at most once per round trip when replies show queueing delay.
+class PipelineWindow
+{
+public:
+  using Duration = std::chrono::microseconds;
+
+  explicit PipelineWindow(const PipelineOptions& options);
+
+  // Number of commands that may be in flight.
+  size_t Depth() const { return static_cast<size_t>(cwnd_); }
+
+  // Called on every flush: whether the sender had more to write than the
+  // window allowed. Stays in effect for all replies until the next flush.
+  void SetWindowLimited(bool limited) { window_limited_ = limited; }
+
+  void OnReply(Duration latency, size_t inflight);
+
+  Duration SmoothedRtt() const { return srtt_; }
+  Duration MinRtt() const { return min_rtt_; }
+
+private:
+  void Increase();
+  void Decrease(size_t inflight);
+
+private:
+  PipelineOptions options_;
+  double cwnd_;
+  Duration srtt_;
+  Duration min_rtt_;
+  Duration epoch_min_rtt_;
+  uint64_t replies_;
+  uint64_t recover_until_;
+  bool window_limited_;
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vector>
+#include "cotask.h"
+#include "redis_client.h"
+
+// co_await CoCommand(client, {...}) sends the command and suspends until
+// its reply, which is the result. Client is anything with RedisClient's
+// Command(args, callback). Argument views must stay valid until the reply,
+// as for Command; temporaries of the co_await expression do. A coroutine
+// whose host has died is left suspended rather than resumed.
+template <typename Client>
+class RedisCommandAwaiter
+{
+public:
+  RedisCommandAwaiter(Client& client, std::vector<RedisArg> args)
+    : client_(client)
+    , args_(std::move(args))
+  {
+  }
+
+  bool await_ready() const { return false; }
+
+  template <typename P>
+  void await_suspend(std::experimental::coroutine_handle<P> coroutine)
+  {
+    async::detail::CoFrameBase* frame = &coroutine.promise();
+    client_.Command(args_,
+      CommandCallback([this, frame](const ZResult<RedisMessage>& reply) {
+        reply_ = reply;
+        frame->Resume();
+      }));
+  }
+
+  ZResult<RedisMessage> await_resume() { return std::move(reply_); }
+
+private:
+  Client& client_;
+  std::vector<RedisArg> args_;
+  ZResult<RedisMessage> reply_;
+};
+
+template <typename Client>
+RedisCommandAwaiter<Client> CoCommand(
+  Client& client, std::vector<RedisArg> args)
+{
+  return RedisCommandAwaiter<Client>(client, std::move(args));
+}
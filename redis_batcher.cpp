@@ -0,0 +1,221 @@
+#include "redis_batcher.h"
+#include <algorithm>
+#include <unordered_map>
+
+static RedisMessage ToMessage(const RedisArray::Element& element)
+{
+  switch (element.index())
+  {
+    case 0:
+      return RedisMessage{std::in_place_index<0>, std::get<0>(element)};
+    case 1:
+      return RedisMessage{std::in_place_index<1>, std::get<1>(element)};
+    case 2:
+      return RedisMessage{std::in_place_index<2>, std::get<2>(element)};
+    default:
+      return RedisMessage{std::in_place_index<3>, std::get<3>(element)};
+  }
+}
+
+RedisBatcher::RedisBatcher(
+  App& app, RedisClient& client, const RedisBatcherOptions& options)
+  : ioctx_(app.IoCtx())
+  , client_(client)
+  , options_(options)
+  , timer_(app.IoCtx())
+  , flush_scheduled_(false)
+{
+  options_.max_batch = std::max<size_t>(options_.max_batch, 1);
+}
+
+RedisBatcher::~RedisBatcher()
+{
+  Flush();
+}
+
+void RedisBatcher::Get(std::string_view key, const CommandCallback& cb_cmd)
+{
+  Add(Call{std::string(key), std::string(), cb_cmd}, gets_);
+}
+
+void RedisBatcher::HGet(
+  std::string_view key, std::string_view field, const CommandCallback& cb_cmd)
+{
+  Add(Call{std::string(key), std::string(field), cb_cmd}, hgets_);
+}
+
+void RedisBatcher::Exists(std::string_view key, const CommandCallback& cb_cmd)
+{
+  Add(Call{std::string(key), std::string(), cb_cmd}, exists_);
+}
+
+void RedisBatcher::Add(Call call, std::vector<Call>& queue)
+{
+  ++stats_.calls;
+  queue.push_back(std::move(call));
+  if (queue.size() >= options_.max_batch)
+  {
+    Flush();
+    return;
+  }
+
+  ScheduleFlush();
+}
+
+void RedisBatcher::ScheduleFlush()
+{
+  if (flush_scheduled_)
+  {
+    return;
+  }
+
+  flush_scheduled_ = true;
+  if (options_.window.count() == 0)
+  {
+    // runs after the handler that made the calls
+    asio::post(ioctx_,
+      [flush = async::Bind<void()>(&RedisBatcher::Flush, this)] {
+        flush.Invoke();
+      });
+    return;
+  }
+
+  timer_.expires_after(options_.window);
+  // a completion already queued still runs after the batcher is gone
+  timer_.async_wait(
+    [flush = async::Bind<void()>(&RedisBatcher::Flush, this)](
+      const std::error_code& ec) {
+      if (!ec)
+      {
+        flush.Invoke();
+      }
+    });
+}
+
+void RedisBatcher::Flush()
+{
+  if (flush_scheduled_ && options_.window.count() != 0)
+  {
+    timer_.cancel();
+  }
+  flush_scheduled_ = false;
+
+  if (gets_.empty() && hgets_.empty() && exists_.empty())
+  {
+    return;
+  }
+
+  ++stats_.flushes;
+  SendGets(std::move(gets_));
+  gets_.clear();
+  SendHGets(std::move(hgets_));
+  hgets_.clear();
+  SendExists(std::move(exists_));
+  exists_.clear();
+}
+
+void RedisBatcher::SendGets(std::vector<Call> calls)
+{
+  for (size_t begin = 0; begin < calls.size(); begin += options_.max_batch)
+  {
+    size_t end = std::min(begin + options_.max_batch, calls.size());
+    auto batch = std::make_shared<Batch>();
+    batch->calls.assign(std::make_move_iterator(calls.begin() + begin),
+      std::make_move_iterator(calls.begin() + end));
+
+    std::vector<RedisArg> args;
+    args.reserve(batch->calls.size() + 1);
+    args.emplace_back(batch->calls.size() == 1 ? "GET" : "MGET");
+    for (const auto& call : batch->calls)
+    {
+      args.emplace_back(call.key, batch);
+    }
+    Send(std::move(args), std::move(batch));
+  }
+}
+
+void RedisBatcher::SendHGets(std::vector<Call> calls)
+{
+  // one HMGET per hash, hashes in the order first asked for
+  std::vector<size_t> group_of(calls.size());
+  std::unordered_map<std::string_view, size_t> index;
+  for (size_t i = 0; i < calls.size(); ++i)
+  {
+    group_of[i] = index.emplace(calls[i].key, index.size()).first->second;
+  }
+
+  // keys are viewed by index, move the calls only once it is complete
+  std::vector<std::vector<Call>> groups(index.size());
+  for (size_t i = 0; i < calls.size(); ++i)
+  {
+    groups[group_of[i]].push_back(std::move(calls[i]));
+  }
+
+  for (auto& group : groups)
+  {
+    for (size_t begin = 0; begin < group.size(); begin += options_.max_batch)
+    {
+      size_t end = std::min(begin + options_.max_batch, group.size());
+      auto batch = std::make_shared<Batch>();
+      batch->calls.assign(std::make_move_iterator(group.begin() + begin),
+        std::make_move_iterator(group.begin() + end));
+
+      std::vector<RedisArg> args;
+      args.reserve(batch->calls.size() + 2);
+      args.emplace_back(batch->calls.size() == 1 ? "HGET" : "HMGET");
+      args.emplace_back(batch->calls.front().key, batch);
+      for (const auto& call : batch->calls)
+      {
+        args.emplace_back(call.field, batch);
+      }
+      Send(std::move(args), std::move(batch));
+    }
+  }
+}
+
+void RedisBatcher::SendExists(std::vector<Call> calls)
+{
+  // EXISTS of several keys only counts them; pipeline one per key instead
+  for (auto& call : calls)
+  {
+    auto batch = std::make_shared<Batch>();
+    batch->calls.push_back(std::move(call));
+    std::vector<RedisArg> args{"EXISTS", {batch->calls.front().key, batch}};
+    Send(std::move(args), std::move(batch));
+  }
+}
+
+void RedisBatcher::Send(
+  std::vector<RedisArg> args, std::shared_ptr<Batch> batch)
+{
+  ++stats_.commands;
+  client_.Command(args,
+    CommandCallback([batch](const ZResult<RedisMessage>& reply) {
+      OnBatchReply(batch, reply);
+    }));
+}
+
+void RedisBatcher::OnBatchReply(
+  const std::shared_ptr<Batch>& batch, const ZResult<RedisMessage>& reply)
+{
+  auto& calls = batch->calls;
+  const RedisArray* array = reply ? std::get_if<3>(&reply.Value()) : nullptr;
+  const RedisArray::Elements* elements =
+    array ? std::get_if<1>(&array->array) : nullptr;
+  if (calls.size() == 1 || elements == nullptr ||
+      elements->size() != calls.size())
+  {
+    // a single command's own reply, or an error for the whole batch
+    for (const auto& call : calls)
+    {
+      call.callback.Invoke(reply);
+    }
+    return;
+  }
+
+  for (size_t i = 0; i < calls.size(); ++i)
+  {
+    calls[i].callback.Invoke(
+      ZResult<RedisMessage>(Success(ToMessage((*elements)[i]))));
+  }
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "app.h"
+#include "callback.h"
+#include "redis_client.h"
+#include "thirtyparty/asio/asio.hpp"
+
+struct RedisBatcherOptions
+{
+  // keys per MGET / fields per HMGET; reaching it flushes at once
+  size_t max_batch = 128;
+  // 0 flushes once the current io_context handler returns, otherwise
+  // calls are held for up to this long
+  std::chrono::microseconds window{0};
+};
+
+struct RedisBatcherStats
+{
+  uint64_t calls = 0;
+  uint64_t commands = 0;
+  uint64_t flushes = 0;
+};
+
+// Opt-in micro-batcher over a RedisClient. GET, HGET and EXISTS calls made
+// close together are collected and sent at the next flush: GETs as MGETs,
+// HGETs of one hash as an HMGET, EXISTS pipelined. Each caller gets its
+// own reply, as if it had sent its command alone, except that MGET and
+// HMGET report a key of the wrong type as nil rather than as an error.
+// Batched calls go out at flush time, after commands sent directly on the
+// client in between.
+class RedisBatcher : public async::CallbackHost
+{
+public:
+  RedisBatcher(App& app, RedisClient& client,
+    const RedisBatcherOptions& options = RedisBatcherOptions{});
+  // Sends the calls still collected; their replies arrive as usual.
+  ~RedisBatcher();
+
+  void Get(std::string_view key, const CommandCallback& cb_cmd);
+  void HGet(std::string_view key, std::string_view field,
+    const CommandCallback& cb_cmd);
+  void Exists(std::string_view key, const CommandCallback& cb_cmd);
+
+  // Send everything collected so far.
+  void Flush();
+
+  RedisBatcherStats Stats() const { return stats_; }
+
+private:
+  struct Call
+  {
+    std::string key;
+    std::string field;
+    CommandCallback callback;
+  };
+
+  // the calls answered by one command
+  struct Batch
+  {
+    std::vector<Call> calls;
+  };
+
+  void Add(Call call, std::vector<Call>& queue);
+  void ScheduleFlush();
+  void SendGets(std::vector<Call> calls);
+  void SendHGets(std::vector<Call> calls);
+  void SendExists(std::vector<Call> calls);
+  void Send(std::vector<RedisArg> args, std::shared_ptr<Batch> batch);
+  static void OnBatchReply(
+    const std::shared_ptr<Batch>& batch, const ZResult<RedisMessage>& reply);
+
+private:
+  asio::io_context& ioctx_;
+  RedisClient& client_;
+  RedisBatcherOptions options_;
+  asio::steady_timer timer_;
+  std::vector<Call> gets_;
+  std::vector<Call> hgets_;
+  std::vector<Call> exists_;
+  bool flush_scheduled_;
+  RedisBatcherStats stats_;
+};
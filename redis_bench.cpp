@@ -0,0 +1,599 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "app.h"
+#include "callback.h"
+#include "redis_client.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// redis-benchmark style load generator built on App and RedisClient.
+// Every connection keeps --pipeline requests outstanding; a request is a GET
+// (with probability --read-ratio) or a SET of a random key out of
+// --keyspace keys. With --unix the same load is run over TCP and then over
+// the UNIX socket. --mock answers from an in-process server running on its
+// own thread, so the client can be measured without a Redis server.
+//
+// usage: redis_bench [--host 127.0.0.1] [--port 6379] [--unix path]
+//                    [--connections 1] [--pipeline 32] [--requests 100000]
+//                    [--keyspace 10000] [--value-size 16] [--read-ratio 0.5]
+//                    [--seed 1] [--mock 1]
+
+///////////////////////////////////////////////////////////////////////////////
+// allocation counting
+static std::atomic<uint64_t> g_allocations{0};
+
+void* operator new(std::size_t size)
+{
+  g_allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* p = std::malloc(size ? size : 1))
+  {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+  std::free(p);
+}
+
+static double CpuSeconds()
+{
+#ifdef _WIN32
+  FILETIME create, exit, kernel, user;
+  ::GetProcessTimes(::GetCurrentProcess(), &create, &exit, &kernel, &user);
+  auto to_seconds = [](const FILETIME& ft) {
+    ULARGE_INTEGER v;
+    v.LowPart = ft.dwLowDateTime;
+    v.HighPart = ft.dwHighDateTime;
+    return v.QuadPart / 1e7;
+  };
+  return to_seconds(kernel) + to_seconds(user);
+#else
+  struct rusage usage;
+  ::getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+         usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+#endif
+}
+
+struct BenchOptions
+{
+  std::string host = "127.0.0.1";
+  unsigned short port = 6379;
+  std::string unix_path;
+  size_t connections = 1;
+  size_t pipeline = 32;
+  size_t requests = 100000;
+  size_t keyspace = 10000;
+  size_t value_size = 16;
+  double read_ratio = 0.5;
+  uint64_t seed = 1;
+  bool mock = false;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// MockServer: answers GET with a value of --value-size bytes and anything
+// else with +OK, on a thread of its own.
+class MockServer
+{
+public:
+  explicit MockServer(const BenchOptions& options)
+    : value_reply_("$" + std::to_string(options.value_size) + "\r\n" +
+                   std::string(options.value_size, 'v') + "\r\n")
+    , tcp_acceptor_(ioctx_,
+        asio::ip::tcp::endpoint(asio::ip::make_address(options.host), 0))
+  {
+    Accept(tcp_acceptor_);
+#if defined(ASIO_HAS_LOCAL_SOCKETS)
+    if (!options.unix_path.empty())
+    {
+      std::remove(options.unix_path.c_str());
+      unix_acceptor_ = std::make_unique<asio::local::stream_protocol::acceptor>(
+        ioctx_, asio::local::stream_protocol::endpoint(options.unix_path));
+      Accept(*unix_acceptor_);
+    }
+#endif
+    thread_ = std::thread([this] { ioctx_.run(); });
+  }
+
+  ~MockServer()
+  {
+    ioctx_.stop();
+    thread_.join();
+  }
+
+  unsigned short Port() const { return tcp_acceptor_.local_endpoint().port(); }
+
+private:
+  template <typename Socket>
+  struct Connection : public std::enable_shared_from_this<Connection<Socket>>
+  {
+    Connection(MockServer* server, Socket socket)
+      : server_(server)
+      , socket_(std::move(socket))
+      , rbuffer_(64 * 1024)
+      , rpos_(0)
+    {
+    }
+
+    void Read()
+    {
+      if (rpos_ == rbuffer_.size())
+      {
+        // a request larger than the buffer, e.g. a SET of a big value
+        rbuffer_.resize(rbuffer_.size() * 2);
+      }
+
+      auto self = this->shared_from_this();
+      socket_.async_read_some(
+        asio::buffer(rbuffer_.data() + rpos_, rbuffer_.size() - rpos_),
+        [self](const std::error_code& ec, std::size_t len) {
+          if (ec)
+          {
+            return;
+          }
+
+          self->rpos_ += len;
+          std::string_view sv(self->rbuffer_.data(), self->rpos_);
+          std::string replies;
+          bool is_get = false;
+          while (ScanRequest(sv, is_get))
+          {
+            replies += is_get ? self->server_->value_reply_ : "+OK\r\n";
+          }
+
+          std::memmove(self->rbuffer_.data(), sv.data(), sv.size());
+          self->rpos_ = sv.size();
+          self->Write(std::move(replies));
+        });
+    }
+
+    void Write(std::string replies)
+    {
+      auto self = this->shared_from_this();
+      auto data = std::make_shared<std::string>(std::move(replies));
+      asio::async_write(socket_, asio::buffer(*data),
+        [self, data](const std::error_code& ec, std::size_t) {
+          if (!ec)
+          {
+            self->Read();
+          }
+        });
+    }
+
+    MockServer* server_;
+    Socket socket_;
+    std::vector<char> rbuffer_;
+    size_t rpos_;
+  };
+
+  // Consume one complete "*N\r\n$len\r\n...\r\n" request from sv.
+  static bool ScanRequest(std::string_view& sv, bool& is_get)
+  {
+    std::string_view rest(sv);
+    auto line = [&rest](size_t& value) {
+      auto pos = rest.find("\r\n");
+      if (pos == std::string_view::npos || pos < 2)
+      {
+        return false;
+      }
+      value = std::strtoull(std::string(rest.substr(1, pos - 1)).c_str(),
+        nullptr, 10);
+      rest.remove_prefix(pos + 2);
+      return true;
+    };
+
+    size_t argc = 0;
+    if (!line(argc))
+    {
+      return false;
+    }
+
+    for (size_t i = 0; i < argc; ++i)
+    {
+      size_t len = 0;
+      if (!line(len) || rest.size() < len + 2)
+      {
+        return false;
+      }
+      if (i == 0)
+      {
+        is_get = len == 3 && (rest[0] == 'G' || rest[0] == 'g');
+      }
+      rest.remove_prefix(len + 2);
+    }
+
+    sv = rest;
+    return true;
+  }
+
+  template <typename Acceptor>
+  void Accept(Acceptor& acceptor)
+  {
+    acceptor.async_accept(
+      [this, &acceptor](const std::error_code& ec, auto socket) {
+        if (!ec)
+        {
+          using Socket = decltype(socket);
+          std::make_shared<Connection<Socket>>(this, std::move(socket))->Read();
+        }
+        Accept(acceptor);
+      });
+  }
+
+private:
+  std::string value_reply_;
+  asio::io_context ioctx_;
+  asio::ip::tcp::acceptor tcp_acceptor_;
+#if defined(ASIO_HAS_LOCAL_SOCKETS)
+  std::unique_ptr<asio::local::stream_protocol::acceptor> unix_acceptor_;
+#endif
+  std::thread thread_;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// LoadGenerator
+class LoadGenerator;
+
+class BenchConnection : public async::CallbackHost
+{
+public:
+  BenchConnection(App& app, LoadGenerator* generator,
+    const PipelineOptions& pipeline);
+
+  RedisClient& Client() { return client_; }
+  void Issue(std::string_view cmd);
+
+private:
+  void OnConnected(int error);
+  void OnDisconnect();
+  void OnReply(const ZResult<RedisMessage>& reply);
+
+private:
+  LoadGenerator* generator_;
+  RedisClient client_;
+  // send times of outstanding requests, replies arrive in the same order
+  std::deque<std::chrono::steady_clock::time_point> sent_;
+};
+
+class LoadGenerator
+{
+public:
+  LoadGenerator(App& app, const BenchOptions& options)
+    : app_(app)
+    , options_(options)
+    , rng_(options.seed)
+    , transport_(0)
+  {
+    std::string value(options_.value_size, 'x');
+    set_suffix_ = "\r\n$" + std::to_string(value.size()) + "\r\n" + value + "\r\n";
+    cmd_.reserve(64 + set_suffix_.size());
+    latencies_.reserve(options_.requests);
+  }
+
+  void Start() { RunNext(); }
+
+  void OnConnected(BenchConnection* conn, int error);
+  void OnReply(BenchConnection* conn, std::chrono::nanoseconds latency,
+    bool error);
+
+private:
+  void RunNext();
+  void IssueNext(BenchConnection* conn);
+  void Report();
+
+private:
+  App& app_;
+  BenchOptions options_;
+  std::mt19937_64 rng_;
+  std::string set_suffix_;
+  std::string cmd_;
+  std::vector<std::unique_ptr<BenchConnection>> conns_;
+  std::string name_;
+  int transport_;
+  size_t connected_ = 0;
+  size_t issued_ = 0;
+  size_t completed_ = 0;
+  size_t errors_ = 0;
+  std::vector<uint64_t> latencies_;
+  std::chrono::steady_clock::time_point start_;
+  double start_cpu_ = 0;
+  uint64_t start_allocations_ = 0;
+};
+
+BenchConnection::BenchConnection(
+  App& app, LoadGenerator* generator, const PipelineOptions& pipeline)
+  : generator_(generator)
+  , client_(app,
+      async::Bind<void(int)>(&BenchConnection::OnConnected, this),
+      async::Bind<void()>(&BenchConnection::OnDisconnect, this), pipeline)
+{
+}
+
+void BenchConnection::Issue(std::string_view cmd)
+{
+  sent_.push_back(std::chrono::steady_clock::now());
+  client_.Command(cmd, async::Bind<void(const ZResult<RedisMessage>&)>(
+                         &BenchConnection::OnReply, this));
+}
+
+void BenchConnection::OnConnected(int error)
+{
+  generator_->OnConnected(this, error);
+}
+
+void BenchConnection::OnDisconnect()
+{
+  std::cout << "connection lost" << std::endl;
+}
+
+void BenchConnection::OnReply(const ZResult<RedisMessage>& reply)
+{
+  auto latency = std::chrono::steady_clock::now() - sent_.front();
+  sent_.pop_front();
+  generator_->OnReply(this, latency, !reply);
+}
+
+void LoadGenerator::RunNext()
+{
+  // fixed depth, so every run sees the same load
+  PipelineOptions pipeline;
+  pipeline.min_depth = options_.pipeline;
+  pipeline.max_depth = options_.pipeline;
+
+  conns_.clear();
+  latencies_.clear();
+  connected_ = issued_ = completed_ = errors_ = 0;
+
+  switch (transport_++)
+  {
+    case 0:
+      name_ = "tcp";
+      for (size_t i = 0; i < options_.connections; ++i)
+      {
+        conns_.push_back(
+          std::make_unique<BenchConnection>(app_, this, pipeline));
+        conns_.back()->Client().Connect(asio::ip::tcp::endpoint(
+          asio::ip::make_address(options_.host), options_.port));
+      }
+      return;
+    case 1:
+      if (!options_.unix_path.empty())
+      {
+#if defined(ASIO_HAS_LOCAL_SOCKETS)
+        name_ = "unix";
+        for (size_t i = 0; i < options_.connections; ++i)
+        {
+          conns_.push_back(
+            std::make_unique<BenchConnection>(app_, this, pipeline));
+          conns_.back()->Client().Connect(
+            asio::local::stream_protocol::endpoint(options_.unix_path));
+        }
+        return;
+#else
+        std::cout << "unix: not supported on this platform" << std::endl;
+#endif
+      }
+      [[fallthrough]];
+    default:
+      app_.IoCtx().stop();
+      break;
+  }
+}
+
+void LoadGenerator::OnConnected(BenchConnection* conn, int error)
+{
+  if (error)
+  {
+    std::cout << name_ << ": connect failed, error " << error << std::endl;
+    app_.IoCtx().stop();
+    return;
+  }
+
+  if (++connected_ < conns_.size())
+  {
+    return;
+  }
+
+  // all connected, start the clock
+  start_ = std::chrono::steady_clock::now();
+  start_cpu_ = CpuSeconds();
+  start_allocations_ = g_allocations.load(std::memory_order_relaxed);
+  for (auto& c : conns_)
+  {
+    for (size_t i = 0; i < options_.pipeline; ++i)
+    {
+      IssueNext(c.get());
+    }
+  }
+}
+
+void LoadGenerator::IssueNext(BenchConnection* conn)
+{
+  if (issued_ == options_.requests)
+  {
+    return;
+  }
+  ++issued_;
+
+  std::string key = std::to_string(rng_() % options_.keyspace);
+  bool is_read = std::generate_canonical<double, 32>(rng_) < options_.read_ratio;
+
+  // "*2\r\n$3\r\nGET\r\n$<n>\r\nkey:<k>\r\n" or the SET equivalent
+  cmd_.assign(is_read ? "*2\r\n$3\r\nGET\r\n$" : "*3\r\n$3\r\nSET\r\n$");
+  cmd_ += std::to_string(key.size() + 4);
+  cmd_ += "\r\nkey:";
+  cmd_ += key;
+  cmd_ += is_read ? "\r\n" : set_suffix_;
+  conn->Issue(cmd_);
+}
+
+void LoadGenerator::OnReply(
+  BenchConnection* conn, std::chrono::nanoseconds latency, bool error)
+{
+  latencies_.push_back(latency.count());
+  errors_ += error ? 1 : 0;
+
+  if (++completed_ == options_.requests)
+  {
+    Report();
+    // leave the reply callback before tearing the connections down
+    asio::post(app_.IoCtx(), [this] { RunNext(); });
+    return;
+  }
+
+  IssueNext(conn);
+}
+
+void LoadGenerator::Report()
+{
+  auto elapsed = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - start_);
+  double cpu = CpuSeconds() - start_cpu_;
+  uint64_t allocations =
+    g_allocations.load(std::memory_order_relaxed) - start_allocations_;
+  // mock server allocations are on another thread but counted as well
+  if (options_.mock)
+  {
+    std::cout << "(cpu and allocations include the mock server)" << std::endl;
+  }
+
+  std::sort(latencies_.begin(), latencies_.end());
+  auto percentile = [this](double p) {
+    size_t idx = static_cast<size_t>(p * (latencies_.size() - 1));
+    return latencies_[idx] / 1000.0;
+  };
+
+  uint64_t borrows = 0;
+  for (const auto& conn : conns_)
+  {
+    borrows += conn->Client().Stats().rbuffer_borrows;
+  }
+  auto buffers = app_.Buffers().Stats();
+
+  double ops = static_cast<double>(completed_);
+  std::cout << name_ << ": " << completed_ << " requests in "
+            << elapsed.count() << "s over " << conns_.size()
+            << " connection(s), pipeline " << options_.pipeline << "\n"
+            << "  ops/sec       " << static_cast<uint64_t>(ops / elapsed.count())
+            << "\n"
+            << "  latency us    p50 " << percentile(0.5) << ", p99 "
+            << percentile(0.99) << ", p999 " << percentile(0.999) << ", max "
+            << latencies_.back() / 1000.0 << "\n"
+            << "  cpu us/op     " << cpu * 1e6 / ops << "\n"
+            << "  allocs/op     " << allocations / ops << "\n"
+            << "  read buffers  " << borrows << " borrowed, peak "
+            << buffers.peak_in_use_bytes / 1024 << " KiB, cached "
+            << buffers.cached_bytes / 1024 << " KiB\n"
+            << "  errors        " << errors_ << std::endl;
+}
+
+static bool ParseOptions(int argc, char* argv[], BenchOptions& options)
+{
+  for (int i = 1; i + 1 < argc; i += 2)
+  {
+    const char* key = argv[i];
+    const char* value = argv[i + 1];
+    if (std::strcmp(key, "--host") == 0)
+    {
+      options.host = value;
+    }
+    else if (std::strcmp(key, "--port") == 0)
+    {
+      options.port = static_cast<unsigned short>(std::atoi(value));
+    }
+    else if (std::strcmp(key, "--unix") == 0)
+    {
+      options.unix_path = value;
+    }
+    else if (std::strcmp(key, "--connections") == 0)
+    {
+      options.connections = std::strtoull(value, nullptr, 10);
+    }
+    else if (std::strcmp(key, "--pipeline") == 0)
+    {
+      options.pipeline = std::strtoull(value, nullptr, 10);
+    }
+    else if (std::strcmp(key, "--requests") == 0)
+    {
+      options.requests = std::strtoull(value, nullptr, 10);
+    }
+    else if (std::strcmp(key, "--keyspace") == 0)
+    {
+      options.keyspace = std::strtoull(value, nullptr, 10);
+    }
+    else if (std::strcmp(key, "--value-size") == 0)
+    {
+      options.value_size = std::strtoull(value, nullptr, 10);
+    }
+    else if (std::strcmp(key, "--read-ratio") == 0)
+    {
+      options.read_ratio = std::atof(value);
+    }
+    else if (std::strcmp(key, "--seed") == 0)
+    {
+      options.seed = std::strtoull(value, nullptr, 10);
+    }
+    else if (std::strcmp(key, "--mock") == 0)
+    {
+      options.mock = std::atoi(value) != 0;
+    }
+    else
+    {
+      std::cout << "unknown option " << key << std::endl;
+      return false;
+    }
+  }
+
+  return (argc % 2) == 1 && options.connections > 0 && options.pipeline > 0 &&
+         options.requests > 0 && options.keyspace > 0;
+}
+
+int main(int argc, char* argv[])
+{
+  BenchOptions options;
+  if (!ParseOptions(argc, argv, options))
+  {
+    std::cout << "usage: redis_bench [--host 127.0.0.1] [--port 6379] "
+                 "[--unix path] [--connections 1] [--pipeline 32] "
+                 "[--requests 100000] [--keyspace 10000] [--value-size 16] "
+                 "[--read-ratio 0.5] [--seed 1] [--mock 1]"
+              << std::endl;
+    return 1;
+  }
+
+  std::unique_ptr<MockServer> mock;
+  if (options.mock)
+  {
+    mock = std::make_unique<MockServer>(options);
+    options.port = mock->Port();
+  }
+
+  App app;
+  LoadGenerator generator(app, options);
+  generator.Start();
+  app.Start();
+
+  return 0;
+}
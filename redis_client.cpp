@@ -1,259 +1,949 @@
 #include "redis_client.h"
-#include <charconv>
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+#ifdef _WIN32
+#include <mstcpip.h>
+#else
+#include <netinet/tcp.h>
+#endif
+#include "redis_command.h"
+#include "sha1.h"
 
-#define SIMPLE_STR_PREFIX '+'
-#define ERROR_PREFIX '-'
-#define INTEGER_PREFIX ':'
-#define BULK_STR_PREFIX '$'
-#define ARRAY_PREFIX '*'
+// Buffer sequence over an array that outlives the write, so the write
+// operation holds two pointers instead of a copy of the vector.
+struct BufferRange
+{
+  using value_type = asio::const_buffer;
+  using const_iterator = const asio::const_buffer*;
+
+  const_iterator begin() const { return first; }
+  const_iterator end() const { return last; }
 
-#define RCE_SUCCESS 0
-#define RCE_LESSDATA 1
-#define RCE_PROTOCOL 2
+  const_iterator first;
+  const_iterator last;
+};
 
 RedisClient::RedisClient(App& app, const ConnectedCallback& cb_conn,
-  const DisconnectCallback& cb_disconn)
-  : ioctx_(app.IoCtx())
+  const DisconnectCallback& cb_disconn, const PipelineOptions& pipeline)
+  : app_(app)
+  , ioctx_(app.IoCtx())
+  , sent_(0)
+  , window_(pipeline)
+  , coalesce_(false)
   , connected_callback_(cb_conn)
   , disconnect_callback_(cb_disconn)
 {
-  session_ = std::make_shared<RedisClient::Session>(
-    this, connected_callback_, disconnect_callback_);
+}
+
+RedisClient::~RedisClient()
+{
+  if (health_)
+  {
+    app_.RemoveTimer(health_->timer);
+  }
+  Close();
+  if (session_)
+  {
+    // a connect or write may still complete
+    session_->client_ = nullptr;
+  }
+  // commands queued while not connected; fire-and-forget ones that cannot
+  // be spilled in order are dropped with the queue
+  OnDisconnect();
+  stats_.spill_dropped += cmds_.size();
 }
 
 void RedisClient::Connect(asio::ip::tcp::endpoint server)
 {
-  session_->Create(server);
+  StartSession<asio::ip::tcp>(server);
+}
+
+void RedisClient::Connect(std::string_view host, uint16_t port)
+{
+  Close();
+
+  // the session exists from now on, so commands queue and Close works
+  // while the name is resolved
+  auto session = MakeIntrusive<StreamSession<asio::ip::tcp>>(
+    this, connected_callback_, disconnect_callback_);
+  session_ = session;
+  app_.Resolver().Resolve(host, port,
+    ResolveCallback([session](const std::error_code& ec,
+                      const std::vector<asio::ip::tcp::endpoint>& servers) {
+      if (!session->Current())
+      {
+        // closed or replaced meanwhile
+        return;
+      }
+
+      if (ec)
+      {
+        session->OnConnect(ec);
+        return;
+      }
+      session->CreateAny(servers);
+    }));
 }
 
+#if defined(ASIO_HAS_LOCAL_SOCKETS)
+void RedisClient::Connect(asio::local::stream_protocol::endpoint server)
+{
+  StartSession<asio::local::stream_protocol>(server);
+}
+#endif
+
 void RedisClient::Close()
 {
+  if (!session_)
+  {
+    return;
+  }
+
+  session_->Disconnect();
   session_->Close();
 }
 
+template <typename Protocol>
+void RedisClient::StartSession(const typename Protocol::endpoint& server)
+{
+  Close();
+
+  auto session = MakeIntrusive<StreamSession<Protocol>>(
+    this, connected_callback_, disconnect_callback_);
+  session_ = session;
+  session->Create(server);
+}
+
 void RedisClient::Command(std::string_view cmd, const CommandCallback& cb_cmd)
 {
-  cmds_.push_back({{cmd.data(), cmd.size()}, cb_cmd});
-  if (cmds_.size() == 1)
+  BreakCoalescing();
+  auto& closure = cmds_.emplace_back();
+  closure.cmd.assign(cmd.data(), cmd.size());
+  closure.callback = cb_cmd;
+  ++stats_.commands;
+  Flush();
+}
+
+void RedisClient::Command(
+  const std::vector<RedisArg>& args, const CommandCallback& cb_cmd)
+{
+  std::vector<std::string_view> views;
+  views.reserve(args.size());
+  for (const auto& arg : args)
+  {
+    views.push_back(arg.data);
+  }
+
+  if (coalesce_ && Coalesce(views, cb_cmd))
   {
-    const auto& closure = cmds_.front();
-    session_->Write(closure.cmd);
+    return;
+  }
+
+  // encode in place: iov may point into closure.cmd, which must not move
+  auto& closure = cmds_.emplace_back();
+  RESPEncoder encoder;
+  encoder.Encode(views, closure.cmd, closure.iov);
+  for (const auto& arg : args)
+  {
+    if (arg.owner)
+    {
+      closure.owners.push_back(arg.owner);
+    }
   }
+  closure.callback = cb_cmd;
+  ++stats_.commands;
+  Flush();
 }
 
-void RedisClient::OnCommandComplete()
+void RedisClient::Send(std::string_view cmd)
 {
-  if (cmds_.empty())
+  BreakCoalescing();
+  if (spill_ && (!Connected() || !spill_->Empty() ||
+                  cmds_.size() >= spill_->Options().queue_limit))
   {
+    if (spill_->Append(cmd))
+    {
+      ++stats_.spilled;
+    }
+    else
+    {
+      ++stats_.spill_dropped;
+    }
     return;
   }
 
-  cmds_.pop_front();
+  auto& closure = cmds_.emplace_back();
+  closure.cmd.assign(cmd.data(), cmd.size());
+  closure.fire_and_forget = true;
+  ++stats_.commands;
+  Flush();
+}
 
-  if (!cmds_.empty())
+void RedisClient::EnableSpill(const SpillOptions& options)
+{
+  spill_ = std::make_unique<SpillLog>(options);
+}
+
+bool RedisClient::EnableCapture(const std::string& path)
+{
+  auto capture = std::make_unique<RESPCaptureWriter>();
+  if (!capture->Open(path))
   {
-    const auto& closure = cmds_.front();
-    session_->Write(closure.cmd);
+    return false;
   }
+
+  capture_ = std::move(capture);
+  return true;
+}
+
+void RedisClient::DisableCapture()
+{
+  capture_.reset();
+}
+
+void RedisClient::CommandRaw(
+  std::string_view cmd, const RawReplyCallback& cb_raw)
+{
+  BreakCoalescing();
+  auto& closure = cmds_.emplace_back();
+  closure.cmd.assign(cmd.data(), cmd.size());
+  closure.raw_callback = cb_raw;
+  ++stats_.commands;
+  Flush();
 }
 
-int RedisClient::Parse(std::string_view sv)
+// Attach cb_cmd to an identical pending read, or queue args as a new read
+// others may attach to. Returns false if args are not coalescable and
+// still need queueing.
+bool RedisClient::Coalesce(
+  const std::vector<std::string_view>& args, const CommandCallback& cb_cmd)
 {
-  auto ret = InternalDecode(sv);
-  if (ret)
+  const RedisCommandInfo* info =
+    args.empty() ? nullptr : LookupRedisCommand(args[0]);
+  bool coalescable = info && (info->flags & kRedisCmdRead) &&
+                     !(info->flags &
+                       (kRedisCmdBlocking | kRedisCmdNondeterministic));
+  for (size_t i = 1; coalescable && i < args.size(); ++i)
   {
-    if (!cmds_.empty())
-    {
-      const auto& cmd = cmds_.front();
-      cmd.callback.Invoke(ret);
-    }
+    // keyed by the whole encoding, which long arguments are not copied to
+    coalescable = args[i].size() < RESPEncoder::kGatherThreshold;
+  }
+
+  if (!coalescable)
+  {
+    BreakCoalescing();
+    return false;
+  }
 
-    return RCE_SUCCESS;
+  std::vector<std::string_view> iov;
+  RESPEncoder().Encode(args, coalesce_key_, iov);
+  ++stats_.coalesce_lookups;
+  auto it = pending_reads_.find(coalesce_key_);
+  if (it != pending_reads_.end())
+  {
+    it->second->waiters.push_back(cb_cmd);
+    ++stats_.coalesced;
+    return true;
   }
 
-  return ret.Error();
+  auto& closure = cmds_.emplace_back();
+  closure.cmd = coalesce_key_;
+  closure.callback = cb_cmd;
+  closure.coalescable = true;
+  pending_reads_.emplace(closure.cmd, &closure);
+  ++stats_.commands;
+  Flush();
+  return true;
 }
 
-ZResult<RedisMessage> RedisClient::InternalDecode(std::string_view& sv)
+// Reads queued after another command must not share a reply with reads
+// queued before it.
+void RedisClient::BreakCoalescing()
 {
-  switch (sv[0])
+  if (!pending_reads_.empty())
+  {
+    pending_reads_.clear();
+  }
+}
+
+void RedisClient::EnableHealthCheck(const HealthCheckOptions& options)
+{
+  if (health_)
+  {
+    app_.RemoveTimer(health_->timer);
+  }
+  else
+  {
+    health_ = std::make_unique<HealthCheck>();
+  }
+
+  health_->options = options;
+  health_->options.max_missed = std::max<uint32_t>(options.max_missed, 1);
+  health_->timer = app_.AddPeriodTimer(options.interval,
+    TickTimerCallback([this](TickTimerID) { OnHealthTimer(); }));
+  if (Connected() && !session_->SetKeepAlive(health_->options))
+  {
+    ++stats_.keepalive_failures;
+  }
+}
+
+void RedisClient::OnHealthTimer()
+{
+  if (!Connected())
+  {
+    return;
+  }
+
+  if (!health_->ping_pending)
+  {
+    // queued like any command, so the round trip includes the queue
+    health_->ping_pending = true;
+    health_->ping_sent = std::chrono::steady_clock::now();
+    ++stats_.pings;
+    Command(std::vector<RedisArg>{"PING"},
+      CommandCallback(
+        [this](const ZResult<RedisMessage>& reply) { OnPong(reply); }));
+    return;
+  }
+
+  ++stats_.missed_pings;
+  if (stats_.missed_pings < health_->options.max_missed || !stats_.healthy)
   {
-    case SIMPLE_STR_PREFIX:
+    return;
+  }
+
+  stats_.healthy = false;
+  ++stats_.unhealthy;
+  if (health_->options.close_unhealthy)
+  {
+    Close();
+  }
+}
+
+void RedisClient::OnPong(const ZResult<RedisMessage>& reply)
+{
+  if (!health_)
+  {
+    return;
+  }
+
+  health_->ping_pending = false;
+  if (!reply)
+  {
+    // failed by a disconnect
+    return;
+  }
+
+  stats_.ping_rtt = std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now() - health_->ping_sent);
+  ++stats_.pongs;
+  stats_.missed_pings = 0;
+  stats_.healthy = true;
+}
+
+const std::string& RedisClient::RegisterScript(std::string_view script)
+{
+  auto [it, inserted] = scripts_.try_emplace(Sha1::Hex(script));
+  if (!inserted)
+  {
+    return it->first;
+  }
+
+  it->second.body.assign(script);
+  if (Connected())
+  {
+    LoadScript(it->first, it->second, false);
+  }
+  return it->first;
+}
+
+void RedisClient::EvalSha(std::string_view sha, size_t numkeys,
+  const std::vector<RedisArg>& keys_and_args, const CommandCallback& cb_cmd)
+{
+  // kept for a retry; the views stay valid until cb_cmd is invoked
+  auto args = std::make_shared<std::vector<RedisArg>>();
+  args->reserve(keys_and_args.size() + 3);
+  args->emplace_back("EVALSHA");
+  args->emplace_back(sha);
+  args->emplace_back(
+    std::make_shared<const std::string>(std::to_string(numkeys)));
+  args->insert(args->end(), keys_and_args.begin(), keys_and_args.end());
+
+  auto it = scripts_.find(std::string(sha));
+  if (it == scripts_.end())
+  {
+    Command(*args, cb_cmd);
+    return;
+  }
+
+  (*args)[1] = RedisArg(it->first);
+  Command(*args,
+    CommandCallback([this, args, cb_cmd](const ZResult<RedisMessage>& reply) {
+      OnEvalShaReply(args, cb_cmd, reply);
+    }));
+}
+
+void RedisClient::OnEvalShaReply(
+  const std::shared_ptr<std::vector<RedisArg>>& args,
+  const CommandCallback& cb_cmd, const ZResult<RedisMessage>& reply)
+{
+  const RedisError* error = reply ? std::get_if<2>(&reply.Value()) : nullptr;
+  if (error == nullptr || error->compare(0, 8, "NOSCRIPT") != 0)
+  {
+    cb_cmd.Invoke(reply);
+    return;
+  }
+
+  // the EVALSHA goes out again behind a SCRIPT LOAD on the same connection,
+  // so nothing waits for the load; one already queued will do
+  ++stats_.script_reloads;
+  auto it = scripts_.find(std::string((*args)[1].data));
+  if (!it->second.loading)
+  {
+    LoadScript(it->first, it->second, false);
+  }
+  Command(*args, cb_cmd);
+}
+
+// Queue SCRIPT LOAD of every registered script ahead of the commands
+// waiting for the connection.
+void RedisClient::LoadScripts()
+{
+  for (auto& [sha, script] : scripts_)
+  {
+    LoadScript(sha, script, true);
+  }
+}
+
+void RedisClient::LoadScript(
+  const std::string& sha, Script& script, bool ahead)
+{
+  // the body lives in scripts_, which never drops a script
+  auto& closure = ahead ? cmds_.emplace_front() : cmds_.emplace_back();
+  RESPEncoder().Encode(
+    std::vector<std::string_view>{"SCRIPT", "LOAD", script.body}, closure.cmd,
+    closure.iov);
+  closure.callback =
+    CommandCallback([this, sha](const ZResult<RedisMessage>&) {
+      scripts_[sha].loading = false;
+    });
+  script.loading = true;
+  ++stats_.commands;
+  if (!ahead)
+  {
+    BreakCoalescing();
+    Flush();
+  }
+}
+
+RedisClientStats RedisClient::Stats() const
+{
+  RedisClientStats stats = stats_;
+  stats.queued = cmds_.size() - sent_;
+  stats.inflight = sent_;
+  stats.pipeline_depth = window_.Depth();
+  stats.srtt = window_.SmoothedRtt();
+  if (window_.MinRtt() != PipelineWindow::Duration::max())
+  {
+    stats.min_rtt = window_.MinRtt();
+  }
+  if (spill_)
+  {
+    stats.spill_bytes = spill_->Bytes();
+  }
+  if (session_)
+  {
+    stats.rbuffer_bytes = session_->pooled_rbuffer_.Size();
+  }
+  return stats;
+}
+
+void RedisClient::Flush(bool speculative)
+{
+  if (!Connected() || session_->writing_ || session_->parsing_)
+  {
+    return;
+  }
+
+  DrainSpill();
+
+  size_t end = std::min(cmds_.size(), window_.Depth());
+  window_.SetWindowLimited(end < cmds_.size());
+
+  if (sent_ >= end)
+  {
+    return;
+  }
+
+  // one gather write for every command the window lets through
+  auto& buffers = wbuffers_;
+  buffers.clear();
+  auto now = std::chrono::steady_clock::now();
+  // nothing in flight: there is no batch to wait for, so write inline
+  speculative = speculative || sent_ == 0;
+  for (; sent_ < end; ++sent_)
+  {
+    auto& closure = cmds_[sent_];
+    closure.sent_at = now;
+    if (closure.iov.empty())
     {
-      return DecodeSimpleStr(sv);
+      buffers.emplace_back(closure.cmd.data(), closure.cmd.size());
+      continue;
     }
-    break;
-    case ERROR_PREFIX:
+
+    for (const auto& sv : closure.iov)
     {
-      return DecodeError(sv);
+      buffers.emplace_back(sv.data(), sv.size());
     }
-    break;
-    case INTEGER_PREFIX:
+  }
+
+  session_->Write(buffers, speculative);
+}
+
+void RedisClient::DrainSpill()
+{
+  if (!spill_ || spill_->Empty())
+  {
+    return;
+  }
+
+  // refill in batches, only once the queue has room for a whole batch
+  const auto& options = spill_->Options();
+  if (cmds_.size() + options.drain_batch > options.queue_limit)
+  {
+    return;
+  }
+
+  BreakCoalescing();
+  for (size_t n = 0; n < options.drain_batch && !spill_->Empty(); ++n)
+  {
+    auto& closure = cmds_.emplace_back();
+    closure.cmd.assign(spill_->Front());
+    closure.fire_and_forget = true;
+    spill_->Pop();
+    ++stats_.commands;
+  }
+}
+
+void RedisClient::OnDisconnect()
+{
+  pending_reads_.clear();
+  auto cmds = std::move(cmds_);
+  cmds_.clear();
+  sent_ = 0;
+
+  // Queued and in-flight fire-and-forget commands may or may not have been
+  // applied, and are older than everything in the spill log. They must go
+  // out again ahead of it, so they are spilled only while the log is empty;
+  // otherwise, or once an append fails, they stay at the front of the queue.
+  bool respill = spill_ && spill_->Empty();
+  ZResult<RedisMessage> error = Failure(RCE_DISCONNECTED);
+  for (auto& closure : cmds)
+  {
+    if (closure.fire_and_forget && spill_)
     {
-      return DecodeInteger(sv);
+      if (respill && spill_->Append(closure.cmd))
+      {
+        ++stats_.spilled;
+        continue;
+      }
+
+      respill = false;
+      cmds_.push_back(std::move(closure));
+      continue;
     }
-    break;
-    case BULK_STR_PREFIX:
+
+    closure.callback.Invoke(error);
+    closure.raw_callback.Invoke(RCE_DISCONNECTED, std::string_view());
+    for (const auto& waiter : closure.waiters)
     {
-      return DecodeBulkStr(sv);
+      waiter.Invoke(error);
     }
-    break;
-    case ARRAY_PREFIX:
+  }
+}
+
+// Consume every complete reply at the front of sv. On return sv holds the
+// incomplete tail, if any.
+int RedisClient::Parse(std::string_view& sv)
+{
+  while (!sv.empty())
+  {
+    std::string_view rest(sv);
+    auto ret = parser_.Parse(rest);
+    if (!ret)
     {
-      return DecodeArray(sv);
+      return ret.Error() == RCE_LESSDATA ? RCE_SUCCESS : ret.Error();
     }
-    break;
-    default:
-      break;
+
+    std::string_view raw = sv.substr(0, sv.size() - rest.size());
+    sv = rest;
+    OnReply(ret, raw);
   }
+
+  return RCE_SUCCESS;
 }
 
-ZResult<RedisString> RedisClient::DecodeSimpleStr(std::string_view& sv)
+void RedisClient::OnReply(
+  const ZResult<RedisMessage>& reply, std::string_view raw)
 {
-  auto pos = sv.find_first_of("\r\n");
-  if (pos == std::string_view::npos)
+  if (sent_ == 0)
+  {
+    // no command waiting for this reply
+    return;
+  }
+
+  if (cmds_.front().coalescable)
   {
-    return Failure(RCE_LESSDATA);
+    auto it = pending_reads_.find(cmds_.front().cmd);
+    if (it != pending_reads_.end() && it->second == &cmds_.front())
+    {
+      pending_reads_.erase(it);
+    }
   }
 
-  RedisString ret = std::string{sv.substr(1, pos - 1)};
-  sv.remove_prefix(pos + 2);
-  return ret;
+  CommandClosure closure = std::move(cmds_.front());
+  cmds_.pop_front();
+  --sent_;
+
+  auto latency = std::chrono::duration_cast<PipelineWindow::Duration>(
+    std::chrono::steady_clock::now() - closure.sent_at);
+  ++stats_.replies;
+  window_.OnReply(latency, sent_);
+
+  closure.callback.Invoke(reply);
+  closure.raw_callback.Invoke(RCE_SUCCESS, raw);
+  for (const auto& waiter : closure.waiters)
+  {
+    waiter.Invoke(reply);
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// RedisClient::Session
+RedisClient::Session::Session(RedisClient* client,
+  const ConnectedCallback& cb_conn, const DisconnectCallback& cb_disconn)
+  : rbuffer_(inline_rbuffer_)
+  , rsize_(INLINE_RBUFSIZE)
+  , rpos_(0)
+  , rsize_hint_(4 * INLINE_RBUFSIZE)
+  , connected_(false)
+  , closed_(false)
+  , writing_(false)
+  , parsing_(false)
+  , client_(client)
+  , conn_callback_(cb_conn)
+  , disconn_callback_(cb_disconn)
+{
 }
 
-ZResult<RedisError> RedisClient::DecodeError(std::string_view& sv)
+void RedisClient::Session::OnConnect(const std::error_code& ec)
 {
-  auto pos = sv.find_first_of("\r\n");
-  if (pos == std::string_view::npos)
+  if (!Current())
   {
-    return Failure(RCE_LESSDATA);
+    // closed or replaced while connecting: a success would take over the
+    // client's queue, a failure would make its owner reconnect
+    return;
   }
 
-  RedisError ret{sv.substr(1, pos - 1)};
-  sv.remove_prefix(pos + 2);
-  return ret;
+  if (ec)
+  {
+    conn_callback_.Invoke(ec.value());
+    return;
+  }
+
+  connected_ = true;
+  if (client_->health_ && !SetKeepAlive(client_->health_->options))
+  {
+    ++client_->stats_.keepalive_failures;
+  }
+  // a new connection is healthy until pings go unanswered
+  client_->stats_.healthy = true;
+  client_->stats_.missed_pings = 0;
+  client_->LoadScripts();
+  conn_callback_.Invoke(RCE_SUCCESS);
+
+  Read();
+  client_->Flush();
 }
 
-ZResult<int64_t> RedisClient::DecodeInteger(std::string_view& sv)
+bool RedisClient::Session::OnReceive(size_t len)
 {
-  auto pos = sv.find_first_of("\r\n");
-  if (pos == std::string_view::npos)
+  if (!connected_)
   {
-    return Failure(RCE_LESSDATA);
+    // replaced or closed meanwhile; OnRead reports it
+    return false;
   }
 
-  int64_t ret;
-  auto [ptr, ec] = std::from_chars(sv.data() + 1, sv.data() + pos, ret);
-  if (ec != std::errc{})
+  if (client_->capture_)
   {
-    return Failure(RCE_PROTOCOL);
+    client_->capture_->Append(std::string_view(rbuffer_ + rpos_, len));
   }
 
-  sv.remove_prefix(pos + 2);
-  return Success(ret);
+  rpos_ += len;
+  if (rpos_ < rsize_)
+  {
+    return false;
+  }
+
+  // a read that filled the buffer probably left more in the socket: grow
+  // so it can be drained before parsing, unless already at the largest
+  size_t size = pooled_rbuffer_ ? rsize_ * 2 : rsize_hint_;
+  size = std::min(size, client_->app_.Buffers().MaxSize());
+  return size > rsize_ && ReserveRead(size);
 }
 
-ZResult<RedisString> RedisClient::DecodeBulkStr(std::string_view& sv)
+bool RedisClient::Session::OnRead()
 {
-  std::string_view sv_copy(sv);
-  auto pos = sv_copy.find_first_of("\r\n");
-  if (pos == std::string_view::npos)
+  if (!connected_)
   {
-    return Failure(RCE_LESSDATA);
+    // replaced or closed meanwhile
+    return false;
   }
 
-  int len = 0;
-  auto [ptr, ec] =
-    std::from_chars(sv_copy.data() + 1, sv_copy.data() + pos, len);
-  if (ec != std::errc{} || len < -1)
+  size_t received = rpos_;
+  std::string_view sv(rbuffer_, rpos_);
+  parsing_ = true;
+  int ret = client_->Parse(sv);
+  parsing_ = false;
+  if (ret != RCE_SUCCESS)
   {
-    return Failure(RCE_PROTOCOL);
+    return false;
   }
 
-  if (len == -1)
+  if (sv.empty())
   {
-    // null string
-    return RedisString(nullptr);
+    rpos_ = 0;
+    if (pooled_rbuffer_)
+    {
+      // borrow as much next time if this burst needed it, else half
+      rsize_hint_ = received * 2 > rsize_ ? rsize_ : rsize_ / 2;
+      rsize_hint_ = std::max<size_t>(rsize_hint_, 2 * INLINE_RBUFSIZE);
+      ReleaseRead();
+    }
   }
-
-  if (sv_copy.size() < pos + 2 + len + 2)
+  else
   {
-    return Failure(RCE_LESSDATA);
+    // keep the incomplete tail for the next read
+    if (sv.data() != rbuffer_)
+    {
+      std::memmove(rbuffer_, sv.data(), sv.size());
+    }
+    rpos_ = sv.size();
+
+    if (rpos_ == rsize_)
+    {
+      size_t size = pooled_rbuffer_ ? rsize_ * 2 : rsize_hint_;
+      size = std::min(size, client_->app_.Buffers().MaxSize());
+      // a reply that cannot fit in the largest buffer never completes
+      if (size <= rsize_ || !ReserveRead(size))
+      {
+        return false;
+      }
+    }
   }
 
-  sv.remove_prefix(pos + 2 + len + 2);
-  return std::string(sv_copy.data() + pos + 2, len);
+  client_->Flush(true);
+  return true;
 }
 
-ZResult<RedisArray> RedisClient::DecodeArray(std::string_view& sv)
+bool RedisClient::Session::ReserveRead(size_t size)
 {
-  std::string_view sv_copy(sv);
-  auto pos = sv_copy.find_first_of("\r\n");
-  if (pos == std::string_view::npos)
+  if (size <= rsize_)
   {
-    return Failure(RCE_LESSDATA);
+    return true;
   }
 
-  int len = 0;
-  auto [ptr, ec] =
-    std::from_chars(sv_copy.data() + 1, sv_copy.data() + pos, len);
-  if (ec != std::errc{} || len < -1)
+  PooledBuffer buffer = client_->app_.Buffers().Acquire(size);
+  if (!buffer)
   {
-    return Failure(RCE_PROTOCOL);
+    return false;
   }
 
-  if (len == -1)
-  {
-    // null array
-    return RedisArray{nullptr};
-  }
+  std::memcpy(buffer.Data(), rbuffer_, rpos_);
+  pooled_rbuffer_ = std::move(buffer);
+  rbuffer_ = pooled_rbuffer_.Data();
+  rsize_ = pooled_rbuffer_.Size();
+  ++client_->stats_.rbuffer_borrows;
+  return true;
+}
 
-  sv.remove_prefix(pos + 2);
+void RedisClient::Session::ReleaseRead()
+{
+  pooled_rbuffer_.Release();
+  rbuffer_ = inline_rbuffer_;
+  rsize_ = INLINE_RBUFSIZE;
+  rpos_ = 0;
+}
+
+void RedisClient::Session::OnReadError()
+{
+  Disconnect();
+  // no read pending any more
+  ReleaseRead();
+}
 
-  RedisArray ret{RedisArray::Elements(len)};
-  for (int i = 0; i < len; ++i)
+void RedisClient::Session::OnWrite()
+{
+  writing_ = false;
+  if (client_)
   {
-    ZResult<RedisArray::Element> result = InternalDecode(sv);
-    if (!result)
-    {
-      return Failure(result.Error());
-    }
+    client_->Flush(true);
+  }
+}
 
-    std::get<1>(ret.array)[i] = result.Value();
+void RedisClient::Session::Disconnect()
+{
+  if (!connected_)
+  {
+    // already reported
+    return;
   }
 
-  return ret;
+  Close();
+  client_->OnDisconnect();
+  disconn_callback_.Invoke();
 }
 
 //////////////////////////////////////////////////////////////////////////////
-// RedisClient::Session
-RedisClient::Session::Session(RedisClient* client,
+// RedisClient::StreamSession
+template <typename Protocol>
+RedisClient::StreamSession<Protocol>::StreamSession(RedisClient* client,
   const ConnectedCallback& cb_conn, const DisconnectCallback& cb_disconn)
-  : client_(client)
+  : Session(client, cb_conn, cb_disconn)
   , socket_(client->ioctx_)
-  , conn_callback_(cb_conn)
-  , disconn_callback_(cb_disconn)
 {
 }
 
-void RedisClient::Session::Create(asio::ip::tcp::endpoint server)
+template <typename Protocol>
+void RedisClient::StreamSession<Protocol>::Create(
+  const typename Protocol::endpoint& server)
 {
-  auto self = shared_from_this();
-  socket_.async_connect(server, [self](const std::error_code& ec) {
-    if (ec)
+  IntrusivePtr<Session> self(this);
+  socket_.async_connect(
+    server, [self](const std::error_code& ec) { self->OnConnect(ec); });
+}
+
+template <typename Protocol>
+void RedisClient::StreamSession<Protocol>::CreateAny(
+  const std::vector<typename Protocol::endpoint>& servers)
+{
+  if (servers.size() == 1)
+  {
+    Create(servers.front());
+    return;
+  }
+
+  race_ = std::make_shared<Race>(client_->ioctx_);
+  race_->servers = servers;
+  StartAttempt(race_);
+}
+
+template <typename Protocol>
+void RedisClient::StreamSession<Protocol>::StartAttempt(
+  const std::shared_ptr<Race>& race)
+{
+  if (race->attempts.size() >= race->servers.size())
+  {
+    // every address is tried, or Close cut the list
+    return;
+  }
+
+  size_t index = race->attempts.size();
+  auto& socket = race->attempts.emplace_back(
+    std::make_unique<typename Protocol::socket>(socket_.get_executor()));
+  IntrusivePtr<StreamSession> self(this);
+  socket->async_connect(race->servers[index],
+    [self, race, index](const std::error_code& ec) {
+      self->OnAttempt(race, index, ec);
+    });
+
+  if (race->attempts.size() < race->servers.size())
+  {
+    race->timer.expires_after(kConnectAttemptDelay);
+    race->timer.async_wait([self, race](const std::error_code& ec) {
+      // cancel does not reach a completion that is already queued, when a
+      // failed attempt or Close got here first
+      if (!ec && !race->done &&
+          race->attempts.size() < race->servers.size())
+      {
+        self->StartAttempt(race);
+      }
+    });
+  }
+}
+
+template <typename Protocol>
+void RedisClient::StreamSession<Protocol>::OnAttempt(
+  const std::shared_ptr<Race>& race, size_t index, const std::error_code& ec)
+{
+  if (race->done)
+  {
+    return;
+  }
+
+  if (!Current())
+  {
+    // closed or replaced: end the race without a report
+    race->done = true;
+    race->timer.cancel();
+    for (auto& attempt : race->attempts)
     {
-      self->conn_callback_.Invoke(ec.value());
-      return;
+      std::error_code ignored;
+      attempt->close(ignored);
     }
+    race_.reset();
+    return;
+  }
 
-    self->conn_callback_.Invoke(RCE_SUCCESS);
+  if (ec)
+  {
+    ++race->failed;
+    if (race->attempts.size() < race->servers.size())
+    {
+      // don't wait out the delay for a failed address
+      race->timer.cancel();
+      StartAttempt(race);
+    }
+    else if (race->failed == race->attempts.size())
+    {
+      race->done = true;
+      race_.reset();
+      OnConnect(ec);
+    }
+    return;
+  }
 
-    self->Read();
-  });
+  race->done = true;
+  race->timer.cancel();
+  socket_ = std::move(*race->attempts[index]);
+  for (auto& attempt : race->attempts)
+  {
+    std::error_code ignored;
+    attempt->close(ignored);
+  }
+  race_.reset();
+  OnConnect(ec);
 }
 
-void RedisClient::Session::Close()
+template <typename Protocol>
+void RedisClient::StreamSession<Protocol>::Close()
 {
+  closed_ = true;
+  if (race_)
+  {
+    // attempts still running fail with operation_aborted and end the race;
+    // a closed session reports nothing
+    race_->servers.resize(race_->attempts.size());
+    race_->timer.cancel();
+    for (auto& attempt : race_->attempts)
+    {
+      std::error_code ignored;
+      attempt->close(ignored);
+    }
+  }
+
+  connected_ = false;
   if (!socket_.is_open())
   {
     return;
@@ -262,46 +952,171 @@ void RedisClient::Session::Close()
   socket_.close();
 }
 
-void RedisClient::Session::Read()
+template <typename Protocol>
+void RedisClient::StreamSession<Protocol>::Read()
 {
-  auto self = shared_from_this();
-  socket_.async_read_some(asio::buffer(rbuffer_ + rpos_, RBUFSIZE - rpos_),
-    [self](const std::error_code& ec, std::size_t len) {
-      if (ec)
-      {
-        self->Close();
-        self->disconn_callback_.Invoke();
-        return;
-      }
+  // for the inline reads and writes; async operations work either way
+  std::error_code ec;
+  socket_.non_blocking(true, ec);
+  if constexpr (std::is_same_v<Protocol, asio::ip::tcp>)
+  {
+    // small inline writes must not wait for the ack of the previous one
+    socket_.set_option(asio::ip::tcp::no_delay(true), ec);
+  }
+  Drain(false);
+}
 
-      self->rpos_ += len;
+template <typename Protocol>
+void RedisClient::StreamSession<Protocol>::Drain(bool unparsed)
+{
+  // Speculative: read inline whatever has already arrived, parsing once the
+  // socket is drained, and wait in the reactor only when it would block.
+  // Capped so one busy connection cannot starve the others.
+  for (size_t n = 0; n < MAX_INLINE_READS && connected_; ++n)
+  {
+    std::error_code ec;
+    size_t len = socket_.read_some(
+      asio::buffer(rbuffer_ + rpos_, rsize_ - rpos_), ec);
+    if (ec == asio::error::would_block)
+    {
+      break;
+    }
 
-      char* buffer = self->rbuffer_;
-      size_t end = self->rpos_;
-      if (end > 2 && buffer[end - 2] == '\r' && buffer[end - 1] == '\n')
-      {
-        std::string_view sv(buffer, end);
-        if (self->client_->Parse(sv) == RCE_SUCCESS)
+    if (ec)
+    {
+      OnReadError();
+      return;
+    }
+
+    ++client_->stats_.sync_reads;
+    unparsed = OnReceive(len);
+    if (!unparsed && !OnRead())
+    {
+      OnReadError();
+      return;
+    }
+  }
+
+  if (unparsed && !OnRead())
+  {
+    OnReadError();
+    return;
+  }
+
+  IntrusivePtr<StreamSession> self(this);
+  socket_.async_read_some(asio::buffer(rbuffer_ + rpos_, rsize_ - rpos_),
+    MakeAllocHandler(
+      read_memory_, [self](const std::error_code& ec, std::size_t len) {
+        if (ec)
         {
-          // reset read position
-          self->rpos_ = 0;
+          self->OnReadError();
+          return;
         }
-      }
 
-      self->client_->OnCommandComplete();
-    });
+        bool unparsed = self->OnReceive(len);
+        if (!unparsed && !self->OnRead())
+        {
+          self->OnReadError();
+          return;
+        }
+
+        self->Drain(unparsed);
+      }));
 }
 
-void RedisClient::Session::Write(const std::string& cmd)
+template <typename Protocol>
+void RedisClient::StreamSession<Protocol>::Write(
+  const std::vector<asio::const_buffer>& buffers, bool speculative)
 {
-  auto self = shared_from_this();
-  asio::async_write(socket_, asio::buffer(cmd.data(), cmd.size()),
-    [self](const std::error_code& ec, std::size_t len) {
-      if (ec)
-      {
-        self->Close();
-        self->disconn_callback_.Invoke();
-        return;
-      }
-    });
+  // Write inline, and leave only what the socket does not take right now
+  // to an async write. Errors are left to the async write too, so they
+  // are reported from the loop as before.
+  size_t len = 0;
+  if (speculative)
+  {
+    std::error_code ec;
+    len = socket_.write_some(buffers, ec);
+    if (ec)
+    {
+      len = 0;
+    }
+    else if (len == asio::buffer_size(buffers))
+    {
+      ++client_->stats_.sync_writes;
+      return;
+    }
+  }
+
+  // the rest lives in wbuffers_ until the write completes
+  wbuffers_.clear();
+  for (const auto& buffer : buffers)
+  {
+    if (len >= buffer.size())
+    {
+      len -= buffer.size();
+      continue;
+    }
+
+    wbuffers_.push_back(buffer + len);
+    len = 0;
+  }
+
+  writing_ = true;
+  IntrusivePtr<Session> self(this);
+  asio::async_write(socket_,
+    BufferRange{wbuffers_.data(), wbuffers_.data() + wbuffers_.size()},
+    MakeAllocHandler(
+      write_memory_, [self](const std::error_code& ec, std::size_t len) {
+        if (ec)
+        {
+          self->writing_ = false;
+          self->Disconnect();
+          return;
+        }
+
+        self->OnWrite();
+      }));
+}
+
+template <typename Protocol>
+bool RedisClient::StreamSession<Protocol>::SetKeepAlive(
+  const HealthCheckOptions& options)
+{
+  if constexpr (std::is_same_v<Protocol, asio::ip::tcp>)
+  {
+    if (!options.keepalive)
+    {
+      return true;
+    }
+
+    std::error_code ec;
+    socket_.set_option(asio::socket_base::keep_alive(true), ec);
+    bool ok = !ec;
+    // zero is rejected by the stacks that take seconds
+    auto idle = std::max(options.keepalive_idle, std::chrono::seconds{1});
+    auto interval =
+      std::max(options.keepalive_interval, std::chrono::seconds{1});
+#ifdef _WIN32
+    using std::chrono::milliseconds;
+    tcp_keepalive values{1,
+      static_cast<ULONG>(milliseconds(idle).count()),
+      static_cast<ULONG>(milliseconds(interval).count())};
+    DWORD bytes = 0;
+    ok = ::WSAIoctl(socket_.native_handle(), SIO_KEEPALIVE_VALS, &values,
+           sizeof(values), nullptr, 0, &bytes, nullptr, nullptr) == 0 && ok;
+#else
+    int idle_secs = static_cast<int>(idle.count());
+    int interval_secs = static_cast<int>(interval.count());
+#ifdef TCP_KEEPIDLE
+    ok = ::setsockopt(socket_.native_handle(), IPPROTO_TCP, TCP_KEEPIDLE,
+           &idle_secs, sizeof(idle_secs)) == 0 && ok;
+#endif
+#ifdef TCP_KEEPINTVL
+    ok = ::setsockopt(socket_.native_handle(), IPPROTO_TCP, TCP_KEEPINTVL,
+           &interval_secs, sizeof(interval_secs)) == 0 && ok;
+#endif
+#endif
+    return ok;
+  }
+  return true;
 }
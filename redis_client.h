@@ -1,71 +1,381 @@
+#pragma once
+
+#include <chrono>
 #include <deque>
 #include <memory>
 #include <string>
 #include <string_view>
+#include <unordered_map>
+#include <vector>
 #include "app.h"
+#include "buffer_pool.h"
 #include "callback.h"
+#include "handler_allocator.h"
+#include "intrusive_ptr.h"
+#include "pipeline_window.h"
+#include "resp_capture.h"
 #include "resp_codec.h"
 #include "result.h"
+#include "spill_log.h"
 #include "thirtyparty/asio/asio.hpp"
 
+#define RCE_DISCONNECTED 3
+
 using ConnectedCallback = async::Callback<void(int)>;
 using DisconnectCallback = async::Callback<void()>;
 using CommandCallback = async::Callback<void(const ZResult<RedisMessage>&)>;
+// Raw reply bytes, only valid during the call; error is RCE_SUCCESS or the
+// reason no reply arrived.
+using RawReplyCallback = async::Callback<void(int, std::string_view)>;
+
+// A command argument. Arguments shorter than RESPEncoder::kGatherThreshold
+// are copied into the encoded command; longer ones are written straight from
+// the caller's memory. A plain view must stay valid until the command
+// callback has been invoked. With an owner, the memory is kept alive by it
+// and released (through the owner's deleter) once the reply has arrived.
+// A temporary std::string is moved into an owner of its own.
+struct RedisArg
+{
+  RedisArg(std::string_view sv)
+    : data(sv)
+  {
+  }
+
+  RedisArg(std::string&& str)
+    : RedisArg(std::make_shared<const std::string>(std::move(str)))
+  {
+  }
+
+  RedisArg(const char* str)
+    : data(str)
+  {
+  }
+
+  RedisArg(std::shared_ptr<const std::string> buffer)
+    : data(*buffer)
+    , owner(std::move(buffer))
+  {
+  }
+
+  RedisArg(std::string_view sv, std::shared_ptr<const void> buffer_owner)
+    : data(sv)
+    , owner(std::move(buffer_owner))
+  {
+  }
+
+  std::string_view data;
+  std::shared_ptr<const void> owner;
+};
+
+struct HealthCheckOptions
+{
+  // a PING is sent this often; one still unanswered when the next is due
+  // counts as missed
+  std::chrono::milliseconds interval{1000};
+  // unhealthy after this many missed pings in a row
+  uint32_t max_missed = 3;
+  // close an unhealthy connection, failing its commands, so the owner's
+  // disconnect handling reconnects
+  bool close_unhealthy = true;
+  // TCP keepalive, set when a TCP connection is established; times below
+  // a second are raised to one
+  bool keepalive = true;
+  std::chrono::seconds keepalive_idle{60};
+  std::chrono::seconds keepalive_interval{10};
+};
+
+struct RedisClientStats
+{
+  uint64_t commands = 0;
+  uint64_t replies = 0;
+  // commands waiting for the pipeline window
+  size_t queued = 0;
+  // commands written and waiting for their reply
+  size_t inflight = 0;
+  // current in-flight limit chosen by the pipeline window
+  size_t pipeline_depth = 0;
+  std::chrono::microseconds srtt{0};
+  std::chrono::microseconds min_rtt{0};
+  // fire-and-forget commands appended to / dropped by the spill log
+  uint64_t spilled = 0;
+  uint64_t spill_dropped = 0;
+  size_t spill_bytes = 0;
+  // reads that could have been coalesced, and those that were; the hit
+  // rate is coalesced / coalesce_lookups
+  uint64_t coalesce_lookups = 0;
+  uint64_t coalesced = 0;
+  // NOSCRIPT replies answered by loading the script and retrying
+  uint64_t script_reloads = 0;
+  // health checks: round trip of the last answered PING, pings missed in
+  // a row, and times the connection was found unhealthy
+  bool healthy = true;
+  std::chrono::microseconds ping_rtt{0};
+  uint64_t pings = 0;
+  uint64_t pongs = 0;
+  uint32_t missed_pings = 0;
+  uint64_t unhealthy = 0;
+  // connections on which the keepalive options could not be set
+  uint64_t keepalive_failures = 0;
+  // pooled read buffer held now, and times one was borrowed
+  size_t rbuffer_bytes = 0;
+  uint64_t rbuffer_borrows = 0;
+  // reads and writes done inline, without a trip through the reactor
+  uint64_t sync_reads = 0;
+  uint64_t sync_writes = 0;
+};
 
 class RedisClient
 {
 public:
+  static constexpr std::chrono::milliseconds kConnectAttemptDelay{250};
+
   RedisClient(App& app, const ConnectedCallback& cb_conn,
-    const DisconnectCallback& cb_disconn);
+    const DisconnectCallback& cb_disconn,
+    const PipelineOptions& pipeline = PipelineOptions{});
+  // Fails pending commands, as Close does.
+  ~RedisClient();
 
   void Connect(asio::ip::tcp::endpoint server);
+  // Resolve host through App's resolver, then race its addresses: a new
+  // attempt starts every kConnectAttemptDelay, or as soon as one fails,
+  // and the first connection established wins.
+  void Connect(std::string_view host, uint16_t port);
+#if defined(ASIO_HAS_LOCAL_SOCKETS)
+  void Connect(asio::local::stream_protocol::endpoint server);
+#endif
   void Close();
 
   void Command(std::string_view cmd, const CommandCallback& cb_cmd);
+  void Command(const std::vector<RedisArg>& args, const CommandCallback& cb_cmd);
+  // Command whose reply is handed over undecoded, for forwarding.
+  void CommandRaw(std::string_view cmd, const RawReplyCallback& cb_raw);
+
+  // Fire-and-forget command. With spilling enabled it goes to the spill
+  // log while the connection is down, the queue is over its limit, or
+  // earlier spilled commands are still waiting; the log is drained back
+  // into the queue once connected. Commands cut off by a disconnect are
+  // sent again, never after commands spilled later.
+  void Send(std::string_view cmd);
+  void EnableSpill(const SpillOptions& options);
+
+  // Coalesce identical reads: a read-only Command(args) identical to one
+  // still pending, with no other command queued since, gets the pending
+  // command's reply instead of going over the wire. Reads whose reply is
+  // not a function of the data (SCAN, SRANDMEMBER, ...) are never shared.
+  void EnableCoalescing() { coalesce_ = true; }
+
+  // Register a Lua script and return its SHA1, under which EvalSha runs
+  // it. Registered scripts are loaded on every connect.
+  const std::string& RegisterScript(std::string_view script);
+  // EVALSHA sha numkeys keys_and_args... A NOSCRIPT reply for a registered
+  // script queues SCRIPT LOAD and the EVALSHA again, without waiting for
+  // the load, and the caller gets the retry's reply.
+  void EvalSha(std::string_view sha, size_t numkeys,
+    const std::vector<RedisArg>& keys_and_args, const CommandCallback& cb_cmd);
+
+  // PING the server every interval while connected; see HealthCheckOptions.
+  void EnableHealthCheck(const HealthCheckOptions& options);
+  // Connected and not found unhealthy by the health check.
+  bool Healthy() const { return Connected() && stats_.healthy; }
+
+  // Append every chunk read from the server, with a timestamp, to a
+  // capture file for offline replay (see resp_replay).
+  bool EnableCapture(const std::string& path);
+  void DisableCapture();
+
+  RedisClientStats Stats() const;
 
 private:
-  struct Session : public std::enable_shared_from_this<Session>
+  // Transport independent part of a connection: read buffer, reply parsing
+  // and state. StreamSession binds it to a stream socket type. Owned by
+  // the client and by its pending I/O handlers, all on the App's thread.
+  struct Session : public RefCounted
   {
     Session(RedisClient* client, const ConnectedCallback& cb_conn,
       const DisconnectCallback& cb_disconn);
-    void Create(asio::ip::tcp::endpoint server);
-    void Close();
-    void Read();
-    void Write(const std::string& cmd);
+    virtual ~Session() = default;
+
+    virtual void Close() = 0;
+    virtual void Read() = 0;
+    // Try writing inline first if speculative, else write asynchronously
+    // so that commands sent meanwhile batch behind it.
+    virtual void Write(
+      const std::vector<asio::const_buffer>& buffers, bool speculative) = 0;
+    // False if the socket rejected any of the options.
+    virtual bool SetKeepAlive(const HealthCheckOptions& options) = 0;
+
+    // Still the client's session and not closed; events of any other
+    // session are stale.
+    bool Current() const
+    {
+      return client_ && client_->session_.get() == this && !closed_;
+    }
+    void OnConnect(const std::error_code& ec);
+    // Account len bytes read at rbuffer_ + rpos_. True if they filled the
+    // buffer and it grew: more is probably waiting in the socket, and
+    // parsing can wait until that has been read too.
+    bool OnReceive(size_t len);
+    // Parse everything received; false on a protocol error or a reply too
+    // long for the largest buffer.
+    bool OnRead();
+    void OnReadError();
+    void OnWrite();
+    void Disconnect();
 
-    asio::ip::tcp::socket socket_;
+    // Make the read buffer hold at least size bytes, keeping its content;
+    // false if that is beyond the pool's largest buffer.
+    bool ReserveRead(size_t size);
+    // Back to the inline buffer, dropping anything unparsed.
+    void ReleaseRead();
 
+    // Short replies are read into the inline buffer. A pooled one is
+    // borrowed while a burst or a long reply is arriving, and given back
+    // once everything read has been parsed, so idle sessions hold none.
     enum
     {
-      RBUFSIZE = 64 * 1024
+      INLINE_RBUFSIZE = 512,
+      // reads tried inline before waiting in the reactor
+      MAX_INLINE_READS = 16
     };
-    char rbuffer_[RBUFSIZE];
+    char inline_rbuffer_[INLINE_RBUFSIZE];
+    PooledBuffer pooled_rbuffer_;
+    char* rbuffer_;
+    size_t rsize_;
     size_t rpos_;
+    // size to borrow when the inline buffer overflows, learned from the
+    // last burst
+    size_t rsize_hint_;
+    bool connected_;
+    bool closed_;
+    bool writing_;
+    // replies are being parsed: commands sent from their callbacks wait
+    // for the one flush after
+    bool parsing_;
     RedisClient* client_;
     const ConnectedCallback& conn_callback_;
     const DisconnectCallback& disconn_callback_;
+    // operations of the one read and one write in flight; a composed
+    // write's operation holds a window of up to 16 buffers
+    HandlerMemory<> read_memory_;
+    HandlerMemory<512> write_memory_;
+    // what an async write still has to send
+    std::vector<asio::const_buffer> wbuffers_;
+  };
+
+  template <typename Protocol>
+  struct StreamSession : public Session
+  {
+    StreamSession(RedisClient* client, const ConnectedCallback& cb_conn,
+      const DisconnectCallback& cb_disconn);
+    void Create(const typename Protocol::endpoint& server);
+    void CreateAny(const std::vector<typename Protocol::endpoint>& servers);
+    void Close() override;
+    void Read() override;
+    void Write(const std::vector<asio::const_buffer>& buffers,
+      bool speculative) override;
+    bool SetKeepAlive(const HealthCheckOptions& options) override;
+
+    // Read inline until the socket would block, then asynchronously;
+    // unparsed if data is already waiting in the buffer.
+    void Drain(bool unparsed);
+
+    // parallel connection attempts of CreateAny
+    struct Race
+    {
+      explicit Race(asio::io_context& ioctx)
+        : timer(ioctx)
+      {
+      }
+
+      std::vector<typename Protocol::endpoint> servers;
+      std::vector<std::unique_ptr<typename Protocol::socket>> attempts;
+      asio::steady_timer timer;
+      size_t failed = 0;
+      bool done = false;
+    };
+
+    void StartAttempt(const std::shared_ptr<Race>& race);
+    void OnAttempt(const std::shared_ptr<Race>& race, size_t index,
+      const std::error_code& ec);
+
+    typename Protocol::socket socket_;
+    std::shared_ptr<Race> race_;
   };
 
   struct CommandClosure
   {
+    // the encoded command, or only its header and short arguments when
+    // iov is not empty
     std::string cmd;
+    // gather list over cmd and referenced long arguments
+    std::vector<std::string_view> iov;
+    std::vector<std::shared_ptr<const void>> owners;
     async::Callback<void(const ZResult<RedisMessage>&)> callback;
+    RawReplyCallback raw_callback;
+    // callers of identical reads coalesced into this one
+    std::vector<CommandCallback> waiters;
+    std::chrono::steady_clock::time_point sent_at;
+    bool fire_and_forget = false;
+    bool coalescable = false;
   };
 
-  int Parse(std::string_view sv);
-  void OnCommandComplete();
+  struct Script
+  {
+    std::string body;
+    // a SCRIPT LOAD is queued; later EVALSHA retries are queued behind it
+    bool loading = false;
+  };
+
+  template <typename Protocol>
+  void StartSession(const typename Protocol::endpoint& server);
+  bool Connected() const { return session_ && session_->connected_; }
 
-  ZResult<RedisMessage> InternalDecode(std::string_view& sv);
-  ZResult<RedisString> DecodeSimpleStr(std::string_view& sv);
-  ZResult<RedisError> DecodeError(std::string_view& sv);
-  ZResult<int64_t> DecodeInteger(std::string_view& sv);
-  ZResult<RedisString> DecodeBulkStr(std::string_view& sv);
-  ZResult<RedisArray> DecodeArray(std::string_view& sv);
+  bool Coalesce(
+    const std::vector<std::string_view>& args, const CommandCallback& cb_cmd);
+  void BreakCoalescing();
+  void OnHealthTimer();
+  void OnPong(const ZResult<RedisMessage>& reply);
+  void LoadScripts();
+  void LoadScript(const std::string& sha, Script& script, bool ahead);
+  void OnEvalShaReply(const std::shared_ptr<std::vector<RedisArg>>& args,
+    const CommandCallback& cb_cmd, const ZResult<RedisMessage>& reply);
+  // speculative: at the end of a read or write cycle, where the commands
+  // queued during it go out in one inline write
+  void Flush(bool speculative = false);
+  void DrainSpill();
+  void OnDisconnect();
+  int Parse(std::string_view& sv);
+  void OnReply(const ZResult<RedisMessage>& reply, std::string_view raw);
+
+  struct HealthCheck
+  {
+    HealthCheckOptions options;
+    TickTimerID timer{nullptr};
+    bool ping_pending = false;
+    std::chrono::steady_clock::time_point ping_sent;
+  };
 
 private:
+  App& app_;
   asio::io_context& ioctx_;
+  // cmds_[0, sent_) are written to the session, the rest wait for the window
   std::deque<CommandClosure> cmds_;
-  std::shared_ptr<Session> session_;
+  size_t sent_;
+  RESPParser parser_;
+  PipelineWindow window_;
+  RedisClientStats stats_;
+  std::unique_ptr<SpillLog> spill_;
+  std::unique_ptr<RESPCaptureWriter> capture_;
+  // pending coalescable reads by encoded command
+  std::unordered_map<std::string_view, CommandClosure*> pending_reads_;
+  std::string coalesce_key_;
+  bool coalesce_;
+  // registered scripts by SHA1
+  std::unordered_map<std::string, Script> scripts_;
+  std::unique_ptr<HealthCheck> health_;
+  IntrusivePtr<Session> session_;
+  // gather list of Flush, kept for its capacity
+  std::vector<asio::const_buffer> wbuffers_;
   ConnectedCallback connected_callback_;
   DisconnectCallback disconnect_callback_;
 };
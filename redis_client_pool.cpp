@@ -0,0 +1,123 @@
+#include "redis_client_pool.h"
+#include <algorithm>
+
+RedisClientPool::RedisClientPool(
+  App& app, size_t size, const PipelineOptions& pipeline)
+  : app_(app)
+  , port_(0)
+  , members_(std::max<size_t>(size, 1))
+  , next_(0)
+  , warming_(0)
+{
+  for (size_t i = 0; i < members_.size(); ++i)
+  {
+    members_[i].client = std::make_unique<RedisClient>(app_,
+      async::Bind<void(int)>(&RedisClientPool::OnConnected, this, i),
+      async::Bind<void()>(&RedisClientPool::OnDisconnect, this, i),
+      pipeline);
+  }
+}
+
+RedisClientPool::~RedisClientPool()
+{
+  // fail pending commands while the rest of the pool is still alive
+  for (auto& member : members_)
+  {
+    member.client.reset();
+  }
+}
+
+void RedisClientPool::Connect(
+  std::string_view host, uint16_t port, const PoolReadyCallback& cb_ready)
+{
+  host_.assign(host);
+  port_ = port;
+  ready_callback_ = cb_ready;
+  connect_start_ = std::chrono::steady_clock::now();
+  warming_ = members_.size();
+  for (auto& member : members_)
+  {
+    member.connected = false;
+    member.warming = true;
+  }
+
+  // all at once; concurrent lookups of the host share one query
+  for (auto& member : members_)
+  {
+    member.client->Connect(host_, port_);
+  }
+}
+
+void RedisClientPool::Command(
+  const std::vector<RedisArg>& args, const CommandCallback& cb_cmd)
+{
+  ++stats_.commands;
+  Next().Command(args, cb_cmd);
+}
+
+RedisClient& RedisClientPool::Next()
+{
+  for (size_t n = 0; n < members_.size(); ++n)
+  {
+    Member& member = members_[next_];
+    next_ = (next_ + 1) % members_.size();
+    if (member.connected)
+    {
+      return *member.client;
+    }
+  }
+
+  // none connected: queue on the next one until it is
+  Member& member = members_[next_];
+  next_ = (next_ + 1) % members_.size();
+  return *member.client;
+}
+
+RedisClientPoolStats RedisClientPool::Stats() const
+{
+  RedisClientPoolStats stats = stats_;
+  stats.connections = members_.size();
+  stats.connected = static_cast<size_t>(
+    std::count_if(members_.begin(), members_.end(),
+      [](const Member& member) { return member.connected; }));
+  return stats;
+}
+
+void RedisClientPool::OnConnected(size_t index, int error)
+{
+  Member& member = members_[index];
+  member.connected = error == 0;
+  if (member.warming)
+  {
+    member.warming = false;
+    if (--warming_ == 0)
+    {
+      stats_.warmup = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - connect_start_);
+      ready_callback_.Invoke(Stats().connected);
+    }
+  }
+
+  if (error)
+  {
+    OnDisconnect(index);
+  }
+}
+
+void RedisClientPool::OnDisconnect(size_t index)
+{
+  // pending commands already failed; retry the connection shortly
+  members_[index].connected = false;
+  app_.AddOneshotTimer(std::chrono::seconds{1},
+    async::Bind<void(TickTimerID)>(
+      &RedisClientPool::OnReconnectTimer, this, index));
+}
+
+void RedisClientPool::OnReconnectTimer(size_t index, TickTimerID timer_id)
+{
+  Member& member = members_[index];
+  if (member.client && !member.connected)
+  {
+    member.client->Connect(host_, port_);
+  }
+}
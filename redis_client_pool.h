@@ -0,0 +1,69 @@
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "app.h"
+#include "callback.h"
+#include "redis_client.h"
+
+// Called once every client has made its first connection attempt, with the
+// number that connected.
+using PoolReadyCallback = async::Callback<void(size_t)>;
+
+struct RedisClientPoolStats
+{
+  size_t connections = 0;
+  size_t connected = 0;
+  uint64_t commands = 0;
+  // from Connect until every client made its first attempt
+  std::chrono::milliseconds warmup{0};
+};
+
+// A fixed number of connections to one server. Connect opens all of them
+// at once, sharing one name lookup, so startup is not serialized on
+// sequential connects; lost connections are reconnected. Commands are
+// spread round-robin over the connected clients.
+class RedisClientPool : public async::CallbackHost
+{
+public:
+  RedisClientPool(App& app, size_t size,
+    const PipelineOptions& pipeline = PipelineOptions{});
+  ~RedisClientPool();
+
+  void Connect(std::string_view host, uint16_t port,
+    const PoolReadyCallback& cb_ready = PoolReadyCallback());
+
+  void Command(
+    const std::vector<RedisArg>& args, const CommandCallback& cb_cmd);
+  // The next client in turn, preferring connected ones.
+  RedisClient& Next();
+
+  RedisClientPoolStats Stats() const;
+
+private:
+  struct Member
+  {
+    std::unique_ptr<RedisClient> client;
+    bool connected = false;
+    // first attempt still running
+    bool warming = false;
+  };
+
+  void OnConnected(size_t index, int error);
+  void OnDisconnect(size_t index);
+  void OnReconnectTimer(size_t index, TickTimerID timer_id);
+
+private:
+  App& app_;
+  std::string host_;
+  uint16_t port_;
+  std::vector<Member> members_;
+  size_t next_;
+  size_t warming_;
+  std::chrono::steady_clock::time_point connect_start_;
+  PoolReadyCallback ready_callback_;
+  RedisClientPoolStats stats_;
+};
@@ -0,0 +1,382 @@
+#include "redis_command.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <string>
+#include <unordered_map>
+
+#define R kRedisCmdRead
+#define W kRedisCmdWrite
+#define B kRedisCmdBlocking
+#define C kRedisCmdConnection
+#define M kRedisCmdMovableKeys
+#define N kRedisCmdNondeterministic
+
+static const RedisCommandInfo kCommands[] = {
+  // strings
+  {"GET", 2, R, 1, 1, 1},
+  {"MGET", -2, R, 1, -1, 1},
+  {"STRLEN", 2, R, 1, 1, 1},
+  {"GETRANGE", 4, R, 1, 1, 1},
+  {"GETBIT", 3, R, 1, 1, 1},
+  {"BITCOUNT", -2, R, 1, 1, 1},
+  {"BITPOS", -3, R, 1, 1, 1},
+  {"SET", -3, W, 1, 1, 1},
+  {"SETNX", 3, W, 1, 1, 1},
+  {"SETEX", 4, W, 1, 1, 1},
+  {"PSETEX", 4, W, 1, 1, 1},
+  {"GETSET", 3, W, 1, 1, 1},
+  {"GETDEL", 2, W, 1, 1, 1},
+  {"GETEX", -2, W, 1, 1, 1},
+  {"MSET", -3, W, 1, -1, 2},
+  {"MSETNX", -3, W, 1, -1, 2},
+  {"APPEND", 3, W, 1, 1, 1},
+  {"SETRANGE", 4, W, 1, 1, 1},
+  {"SETBIT", 4, W, 1, 1, 1},
+  {"INCR", 2, W, 1, 1, 1},
+  {"DECR", 2, W, 1, 1, 1},
+  {"INCRBY", 3, W, 1, 1, 1},
+  {"DECRBY", 3, W, 1, 1, 1},
+  {"INCRBYFLOAT", 3, W, 1, 1, 1},
+  // keyspace
+  {"EXISTS", -2, R, 1, -1, 1},
+  {"TYPE", 2, R, 1, 1, 1},
+  {"TTL", 2, R, 1, 1, 1},
+  {"PTTL", 2, R, 1, 1, 1},
+  {"TOUCH", -2, R, 1, -1, 1},
+  {"DUMP", 2, R, 1, 1, 1},
+  {"SCAN", -2, R | N, 0, 0, 0},
+  {"KEYS", 2, R, 0, 0, 0},
+  {"RANDOMKEY", 1, R | N, 0, 0, 0},
+  {"DBSIZE", 1, R, 0, 0, 0},
+  {"DEL", -2, W, 1, -1, 1},
+  {"UNLINK", -2, W, 1, -1, 1},
+  {"EXPIRE", -3, W, 1, 1, 1},
+  {"PEXPIRE", -3, W, 1, 1, 1},
+  {"EXPIREAT", -3, W, 1, 1, 1},
+  {"PEXPIREAT", -3, W, 1, 1, 1},
+  {"PERSIST", 2, W, 1, 1, 1},
+  {"RENAME", 3, W, 1, 2, 1},
+  {"RENAMENX", 3, W, 1, 2, 1},
+  {"RESTORE", -4, W, 1, 1, 1},
+  {"FLUSHDB", -1, W, 0, 0, 0},
+  {"FLUSHALL", -1, W, 0, 0, 0},
+  // hashes
+  {"HGET", 3, R, 1, 1, 1},
+  {"HMGET", -3, R, 1, 1, 1},
+  {"HGETALL", 2, R, 1, 1, 1},
+  {"HEXISTS", 3, R, 1, 1, 1},
+  {"HLEN", 2, R, 1, 1, 1},
+  {"HKEYS", 2, R, 1, 1, 1},
+  {"HVALS", 2, R, 1, 1, 1},
+  {"HSTRLEN", 3, R, 1, 1, 1},
+  {"HSCAN", -3, R | N, 1, 1, 1},
+  {"HRANDFIELD", -2, R | N, 1, 1, 1},
+  {"HSET", -4, W, 1, 1, 1},
+  {"HSETNX", 4, W, 1, 1, 1},
+  {"HMSET", -4, W, 1, 1, 1},
+  {"HDEL", -3, W, 1, 1, 1},
+  {"HINCRBY", 4, W, 1, 1, 1},
+  {"HINCRBYFLOAT", 4, W, 1, 1, 1},
+  // lists
+  {"LRANGE", 4, R, 1, 1, 1},
+  {"LLEN", 2, R, 1, 1, 1},
+  {"LINDEX", 3, R, 1, 1, 1},
+  {"LPOS", -3, R, 1, 1, 1},
+  {"LPUSH", -3, W, 1, 1, 1},
+  {"RPUSH", -3, W, 1, 1, 1},
+  {"LPUSHX", -3, W, 1, 1, 1},
+  {"RPUSHX", -3, W, 1, 1, 1},
+  {"LPOP", -2, W, 1, 1, 1},
+  {"RPOP", -2, W, 1, 1, 1},
+  {"LSET", 4, W, 1, 1, 1},
+  {"LREM", 4, W, 1, 1, 1},
+  {"LTRIM", 4, W, 1, 1, 1},
+  {"LINSERT", 5, W, 1, 1, 1},
+  {"LMOVE", 5, W, 1, 2, 1},
+  {"RPOPLPUSH", 3, W, 1, 2, 1},
+  {"BLPOP", -3, W | B, 1, -2, 1},
+  {"BRPOP", -3, W | B, 1, -2, 1},
+  {"BLMOVE", 6, W | B, 1, 2, 1},
+  {"BRPOPLPUSH", 4, W | B, 1, 2, 1},
+  // sets
+  {"SMEMBERS", 2, R, 1, 1, 1},
+  {"SISMEMBER", 3, R, 1, 1, 1},
+  {"SMISMEMBER", -3, R, 1, 1, 1},
+  {"SCARD", 2, R, 1, 1, 1},
+  {"SRANDMEMBER", -2, R | N, 1, 1, 1},
+  {"SSCAN", -3, R | N, 1, 1, 1},
+  {"SUNION", -2, R, 1, -1, 1},
+  {"SINTER", -2, R, 1, -1, 1},
+  {"SDIFF", -2, R, 1, -1, 1},
+  {"SADD", -3, W, 1, 1, 1},
+  {"SREM", -3, W, 1, 1, 1},
+  {"SPOP", -2, W, 1, 1, 1},
+  {"SMOVE", 4, W, 1, 2, 1},
+  {"SUNIONSTORE", -3, W, 1, -1, 1},
+  {"SINTERSTORE", -3, W, 1, -1, 1},
+  {"SDIFFSTORE", -3, W, 1, -1, 1},
+  // sorted sets
+  {"ZRANGE", -4, R, 1, 1, 1},
+  {"ZRANGEBYSCORE", -4, R, 1, 1, 1},
+  {"ZREVRANGE", -4, R, 1, 1, 1},
+  {"ZREVRANGEBYSCORE", -4, R, 1, 1, 1},
+  {"ZSCORE", 3, R, 1, 1, 1},
+  {"ZMSCORE", -3, R, 1, 1, 1},
+  {"ZRANK", 3, R, 1, 1, 1},
+  {"ZREVRANK", 3, R, 1, 1, 1},
+  {"ZCARD", 2, R, 1, 1, 1},
+  {"ZCOUNT", 4, R, 1, 1, 1},
+  {"ZSCAN", -3, R | N, 1, 1, 1},
+  {"ZRANDMEMBER", -2, R | N, 1, 1, 1},
+  {"ZUNION", -3, R | M, 0, 0, 0},
+  {"ZINTER", -3, R | M, 0, 0, 0},
+  {"ZDIFF", -3, R | M, 0, 0, 0},
+  {"ZADD", -4, W, 1, 1, 1},
+  {"ZREM", -3, W, 1, 1, 1},
+  {"ZINCRBY", 4, W, 1, 1, 1},
+  {"ZPOPMIN", -2, W, 1, 1, 1},
+  {"ZPOPMAX", -2, W, 1, 1, 1},
+  {"ZREMRANGEBYSCORE", 4, W, 1, 1, 1},
+  {"ZREMRANGEBYRANK", 4, W, 1, 1, 1},
+  {"ZUNIONSTORE", -4, W | M, 0, 0, 0},
+  {"ZINTERSTORE", -4, W | M, 0, 0, 0},
+  {"ZDIFFSTORE", -4, W | M, 0, 0, 0},
+  {"BZPOPMIN", -3, W | B, 1, -2, 1},
+  {"BZPOPMAX", -3, W | B, 1, -2, 1},
+  // hyperloglog
+  {"PFCOUNT", -2, R, 1, -1, 1},
+  {"PFADD", -2, W, 1, 1, 1},
+  {"PFMERGE", -2, W, 1, -1, 1},
+  // streams
+  {"XRANGE", -4, R, 1, 1, 1},
+  {"XREVRANGE", -4, R, 1, 1, 1},
+  {"XLEN", 2, R, 1, 1, 1},
+  {"XPENDING", -3, R, 1, 1, 1},
+  {"XREAD", -4, R | B | M, 0, 0, 0},
+  {"XADD", -5, W, 1, 1, 1},
+  {"XDEL", -3, W, 1, 1, 1},
+  {"XTRIM", -4, W, 1, 1, 1},
+  {"XACK", -4, W, 1, 1, 1},
+  {"XCLAIM", -6, W, 1, 1, 1},
+  {"XAUTOCLAIM", -6, W, 1, 1, 1},
+  {"XGROUP", -2, W, 2, 2, 1},
+  {"XREADGROUP", -7, W | B | M, 0, 0, 0},
+  // scripting
+  {"EVAL", -3, W | M, 0, 0, 0},
+  {"EVALSHA", -3, W | M, 0, 0, 0},
+  {"EVAL_RO", -3, R | M, 0, 0, 0},
+  {"EVALSHA_RO", -3, R | M, 0, 0, 0},
+  {"FCALL", -3, W | M, 0, 0, 0},
+  {"FCALL_RO", -3, R | M, 0, 0, 0},
+  // connection and server
+  {"PING", -1, 0, 0, 0, 0},
+  {"ECHO", 2, 0, 0, 0, 0},
+  {"INFO", -1, 0, 0, 0, 0},
+  {"TIME", 1, 0, 0, 0, 0},
+  {"COMMAND", -1, 0, 0, 0, 0},
+  {"CONFIG", -2, 0, 0, 0, 0},
+  {"SCRIPT", -2, 0, 0, 0, 0},
+  {"PUBLISH", 3, 0, 0, 0, 0},
+  {"WAIT", 3, B, 0, 0, 0},
+  {"AUTH", -2, C, 0, 0, 0},
+  {"HELLO", -1, C, 0, 0, 0},
+  {"SELECT", 2, C, 0, 0, 0},
+  {"CLIENT", -2, C, 0, 0, 0},
+  {"RESET", 1, C, 0, 0, 0},
+  {"MULTI", 1, C, 0, 0, 0},
+  {"EXEC", 1, C, 0, 0, 0},
+  {"DISCARD", 1, C, 0, 0, 0},
+  {"WATCH", -2, C, 1, -1, 1},
+  {"UNWATCH", 1, C, 0, 0, 0},
+  {"SUBSCRIBE", -2, C, 0, 0, 0},
+  {"UNSUBSCRIBE", -1, C, 0, 0, 0},
+  {"PSUBSCRIBE", -2, C, 0, 0, 0},
+  {"PUNSUBSCRIBE", -1, C, 0, 0, 0},
+  {"MONITOR", 1, C, 0, 0, 0},
+  {"SYNC", 1, C, 0, 0, 0},
+};
+
+#undef R
+#undef W
+#undef B
+#undef C
+#undef M
+#undef N
+
+const RedisCommandInfo* LookupRedisCommand(std::string_view name)
+{
+  static const auto* table = [] {
+    auto* table =
+      new std::unordered_map<std::string_view, const RedisCommandInfo*>();
+    for (const auto& info : kCommands)
+    {
+      table->emplace(info.name, &info);
+    }
+    return table;
+  }();
+
+  // longest name in the table is 16 characters
+  char upper[24];
+  if (name.size() > sizeof(upper))
+  {
+    return nullptr;
+  }
+
+  for (size_t i = 0; i < name.size(); ++i)
+  {
+    upper[i] =
+      static_cast<char>(std::toupper(static_cast<unsigned char>(name[i])));
+  }
+
+  auto it = table->find(std::string_view(upper, name.size()));
+  return it == table->end() ? nullptr : it->second;
+}
+
+static bool ParseCount(std::string_view arg, size_t& count)
+{
+  std::string str(arg);
+  char* end = nullptr;
+  long long value = std::strtoll(str.c_str(), &end, 10);
+  if (str.empty() || *end != '\0' || value < 0)
+  {
+    return false;
+  }
+
+  count = static_cast<size_t>(value);
+  return true;
+}
+
+static bool EqualsNoCase(std::string_view a, std::string_view b)
+{
+  if (a.size() != b.size())
+  {
+    return false;
+  }
+
+  for (size_t i = 0; i < a.size(); ++i)
+  {
+    if (std::toupper(static_cast<unsigned char>(a[i])) !=
+        std::toupper(static_cast<unsigned char>(b[i])))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Keys of the commands flagged kRedisCmdMovableKeys.
+static bool MovableKeys(const RedisCommandInfo& info,
+  const std::vector<std::string_view>& args, std::vector<size_t>& keys)
+{
+  std::string_view name(info.name);
+  size_t count = 0;
+  size_t first = 0;
+  if (name == "XREAD" || name == "XREADGROUP")
+  {
+    // ... STREAMS key [key ...] id [id ...]
+    size_t i = 1;
+    while (i < args.size() && !EqualsNoCase(args[i], "STREAMS"))
+    {
+      ++i;
+    }
+    size_t rest = args.size() - std::min(args.size(), i + 1);
+    if (rest == 0 || rest % 2 != 0)
+    {
+      return false;
+    }
+    first = i + 1;
+    count = rest / 2;
+  }
+  else if (name == "ZUNIONSTORE" || name == "ZINTERSTORE" ||
+           name == "ZDIFFSTORE")
+  {
+    // destination numkeys key [key ...]
+    if (args.size() < 4 || !ParseCount(args[2], count))
+    {
+      return false;
+    }
+    keys.push_back(1);
+    first = 3;
+  }
+  else
+  {
+    // EVAL script numkeys key [key ...], ZUNION numkeys key [key ...]
+    size_t numkeys = name[0] == 'Z' ? 1 : 2;
+    if (args.size() <= numkeys || !ParseCount(args[numkeys], count))
+    {
+      return false;
+    }
+    first = numkeys + 1;
+  }
+
+  if (first + count > args.size())
+  {
+    return false;
+  }
+
+  for (size_t i = 0; i < count; ++i)
+  {
+    keys.push_back(first + i);
+  }
+  return true;
+}
+
+bool RedisCommandKeys(const RedisCommandInfo& info,
+  const std::vector<std::string_view>& args, std::vector<size_t>& keys)
+{
+  int argc = static_cast<int>(args.size());
+  if ((info.arity >= 0 && argc != info.arity) ||
+      (info.arity < 0 && argc < -info.arity))
+  {
+    return false;
+  }
+
+  if (info.flags & kRedisCmdMovableKeys)
+  {
+    return MovableKeys(info, args, keys);
+  }
+
+  if (info.first_key == 0)
+  {
+    return true;
+  }
+
+  int last = info.last_key < 0 ? argc + info.last_key : info.last_key;
+  for (int i = info.first_key; i <= last; i += info.key_step)
+  {
+    if (i + info.key_step > argc)
+    {
+      // a key without its values
+      return false;
+    }
+    keys.push_back(static_cast<size_t>(i));
+  }
+  return true;
+}
+
+bool RedisCommandBlocks(
+  const RedisCommandInfo& info, const std::vector<std::string_view>& args)
+{
+  if (!(info.flags & kRedisCmdBlocking))
+  {
+    return false;
+  }
+
+  std::string_view name(info.name);
+  if (name != "XREAD" && name != "XREADGROUP")
+  {
+    return true;
+  }
+
+  // options come before STREAMS
+  for (size_t i = 1; i < args.size() && !EqualsNoCase(args[i], "STREAMS");
+       ++i)
+  {
+    if (EqualsNoCase(args[i], "BLOCK"))
+    {
+      return true;
+    }
+  }
+  return false;
+}
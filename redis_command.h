@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+enum RedisCommandFlag : uint32_t
+{
+  // only reads the keyspace; may be served by a replica
+  kRedisCmdRead = 1 << 0,
+  kRedisCmdWrite = 1 << 1,
+  // may block the connection waiting for data
+  kRedisCmdBlocking = 1 << 2,
+  // changes the state of the connection (transactions, pub/sub, auth...)
+  kRedisCmdConnection = 1 << 3,
+  // key positions depend on the arguments, see RedisCommandKeys
+  kRedisCmdMovableKeys = 1 << 4,
+  // the reply may differ between identical calls on the same data (random
+  // picks, cursors); never shared between callers
+  kRedisCmdNondeterministic = 1 << 5,
+};
+
+// Static description of a command, after the table Redis reports through
+// COMMAND. arity counts the command name, negative means at least -arity.
+// Keys are args[first_key], args[first_key + key_step], ... up to last_key;
+// a negative last_key counts from the end (-1 is the last argument).
+struct RedisCommandInfo
+{
+  const char* name;
+  int arity;
+  uint32_t flags;
+  int first_key;
+  int last_key;
+  int key_step;
+};
+
+// Case insensitive; nullptr for commands not in the table.
+const RedisCommandInfo* LookupRedisCommand(std::string_view name);
+
+// Append the positions of the key arguments in args (args[0] is the command
+// name) to keys. Returns false if args do not fit the command.
+bool RedisCommandKeys(const RedisCommandInfo& info,
+  const std::vector<std::string_view>& args, std::vector<size_t>& keys);
+
+// Whether this invocation can block the connection: commands flagged
+// kRedisCmdBlocking, except XREAD and XREADGROUP without BLOCK.
+bool RedisCommandBlocks(
+  const RedisCommandInfo& info, const std::vector<std::string_view>& args);
@@ -0,0 +1,205 @@
+#include "redis_proxy.h"
+#include <algorithm>
+#include "redis_command.h"
+
+static RedisMessage MakeError(const char* msg)
+{
+  return RedisMessage{std::in_place_index<2>, msg};
+}
+
+// Commands that would change the state of, or block, a shared upstream
+// connection.
+static bool IsConnectionBound(std::string_view name)
+{
+  const RedisCommandInfo* info = LookupRedisCommand(name);
+  return info && (info->flags & (kRedisCmdBlocking | kRedisCmdConnection));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// RedisProxy
+RedisProxy::RedisProxy(App& app, const RedisProxyOptions& options)
+  : app_(app)
+  , options_(options)
+  , acceptor_(app.IoCtx())
+{
+  upstreams_.resize(std::max<size_t>(options_.upstream_connections, 1));
+  for (size_t i = 0; i < upstreams_.size(); ++i)
+  {
+    upstreams_[i].client = std::make_unique<RedisClient>(app_,
+      async::Bind<void(int)>(&RedisProxy::OnUpstreamConnected, this, i),
+      async::Bind<void()>(&RedisProxy::OnUpstreamDisconnect, this, i),
+      options_.pipeline);
+  }
+}
+
+RedisProxy::~RedisProxy()
+{
+  Stop();
+  for (auto* conn : conns_)
+  {
+    conn->Detach();
+  }
+}
+
+void RedisProxy::Start()
+{
+  for (auto& upstream : upstreams_)
+  {
+    upstream.client->Connect(options_.upstream);
+  }
+
+  acceptor_.open(options_.listen.protocol());
+  acceptor_.set_option(asio::ip::tcp::acceptor::reuse_address(true));
+  acceptor_.bind(options_.listen);
+  acceptor_.listen();
+  Accept();
+}
+
+void RedisProxy::Stop()
+{
+  std::error_code ec;
+  acceptor_.close(ec);
+
+  // Close may drop the last reference to a connection
+  std::vector<Connection*> conns(conns_.begin(), conns_.end());
+  for (auto* conn : conns)
+  {
+    conn->Close();
+  }
+}
+
+RedisProxyStats RedisProxy::Stats() const
+{
+  RedisProxyStats stats = stats_;
+  stats.clients = conns_.size();
+  return stats;
+}
+
+void RedisProxy::Accept()
+{
+  acceptor_.async_accept(
+    [this](const std::error_code& ec, asio::ip::tcp::socket socket) {
+      if (ec)
+      {
+        return;
+      }
+
+      socket.set_option(asio::ip::tcp::no_delay(true));
+      auto conn = std::make_shared<Connection>(
+        this, std::move(socket), PickUpstream());
+      conn->Start();
+
+      Accept();
+    });
+}
+
+size_t RedisProxy::PickUpstream()
+{
+  // fewest pinned clients
+  size_t best = 0;
+  for (size_t i = 1; i < upstreams_.size(); ++i)
+  {
+    if (upstreams_[i].clients < upstreams_[best].clients)
+    {
+      best = i;
+    }
+  }
+  return best;
+}
+
+void RedisProxy::OnUpstreamConnected(size_t index, int error)
+{
+  if (error)
+  {
+    OnUpstreamDisconnect(index);
+  }
+}
+
+void RedisProxy::OnUpstreamDisconnect(size_t index)
+{
+  // pending requests already failed; retry the connection shortly
+  app_.AddOneshotTimer(std::chrono::seconds{1},
+    async::Bind<void(TickTimerID)>(&RedisProxy::OnReconnectTimer, this, index));
+}
+
+void RedisProxy::OnReconnectTimer(size_t index, TickTimerID timer_id)
+{
+  upstreams_[index].client->Connect(options_.upstream);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// RedisProxy::Connection
+RedisProxy::Connection::Connection(
+  RedisProxy* proxy, asio::ip::tcp::socket socket, size_t upstream)
+  : RESPConnection(std::move(socket), proxy->options_.max_pending_replies,
+      proxy->options_.max_request_size)
+  , proxy_(proxy)
+  , upstream_(upstream)
+{
+  proxy_->conns_.insert(this);
+  ++proxy_->upstreams_[upstream_].clients;
+}
+
+RedisProxy::Connection::~Connection()
+{
+  if (proxy_)
+  {
+    --proxy_->upstreams_[upstream_].clients;
+    proxy_->conns_.erase(this);
+  }
+}
+
+void RedisProxy::Connection::HandleRequest(
+  const RedisMessage& request, std::string_view raw)
+{
+  if (proxy_ == nullptr)
+  {
+    return;
+  }
+
+  ++proxy_->stats_.requests;
+
+  std::string name = CommandName(request);
+  if (name.empty())
+  {
+    ++proxy_->stats_.rejected;
+    Reply(MakeError("ERR invalid request"));
+    return;
+  }
+
+  if (name == "QUIT")
+  {
+    Reply("+OK\r\n");
+    CloseAfterReplies();
+    return;
+  }
+
+  if (IsConnectionBound(name))
+  {
+    ++proxy_->stats_.rejected;
+    Reply(MakeError("ERR command not supported by proxy"));
+    return;
+  }
+
+  ReplySlot* slot = Reserve();
+  auto self = std::static_pointer_cast<Connection>(shared_from_this());
+  proxy_->upstreams_[upstream_].client->CommandRaw(raw,
+    RawReplyCallback(
+      [self, slot](int error, std::string_view reply) {
+        self->OnUpstreamReply(slot, error, reply);
+      }));
+}
+
+void RedisProxy::Connection::OnUpstreamReply(
+  ReplySlot* slot, int error, std::string_view raw)
+{
+  // one write per batch of upstream replies
+  if (error)
+  {
+    Fill(slot, RESPEncoder().Encode(MakeError("ERR upstream unavailable")));
+  }
+  else
+  {
+    Fill(slot, raw);
+  }
+}
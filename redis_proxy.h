@@ -0,0 +1,92 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+#include "app.h"
+#include "callback.h"
+#include "redis_client.h"
+#include "resp_connection.h"
+#include "resp_codec.h"
+#include "thirtyparty/asio/asio.hpp"
+
+struct RedisProxyOptions
+{
+  asio::ip::tcp::endpoint listen;
+  asio::ip::tcp::endpoint upstream;
+  size_t upstream_connections = 4;
+  PipelineOptions pipeline;
+  // a client stops being read while this many replies are outstanding
+  size_t max_pending_replies = 1024;
+  // a client whose request grows past this is closed with a protocol error
+  size_t max_request_size = RESPConnection::kDefaultMaxRequestSize;
+};
+
+struct RedisProxyStats
+{
+  size_t clients = 0;
+  uint64_t requests = 0;
+  uint64_t rejected = 0;
+};
+
+// Accepts RESP clients and multiplexes their requests onto a few pipelined
+// upstream RedisClient connections. Each client is pinned to one upstream,
+// so its requests keep their order at the server; replies are queued in
+// request order and written back once per batch of upstream replies.
+// Commands that change or block the shared connection are rejected.
+class RedisProxy : public async::CallbackHost
+{
+public:
+  RedisProxy(App& app, const RedisProxyOptions& options);
+  ~RedisProxy();
+
+  void Start();
+  void Stop();
+
+  RedisProxyStats Stats() const;
+
+private:
+  class Connection : public RESPConnection
+  {
+  public:
+    Connection(
+      RedisProxy* proxy, asio::ip::tcp::socket socket, size_t upstream);
+    ~Connection();
+
+    // The proxy is going away; pending upstream replies may keep the
+    // connection alive past it.
+    void Detach() { proxy_ = nullptr; }
+
+  private:
+    void HandleRequest(
+      const RedisMessage& request, std::string_view raw) override;
+    void OnUpstreamReply(ReplySlot* slot, int error, std::string_view raw);
+
+  private:
+    RedisProxy* proxy_;
+    size_t upstream_;
+  };
+
+  struct Upstream
+  {
+    std::unique_ptr<RedisClient> client;
+    size_t clients = 0;
+  };
+
+  void Accept();
+  void OnUpstreamConnected(size_t index, int error);
+  void OnUpstreamDisconnect(size_t index);
+  void OnReconnectTimer(size_t index, TickTimerID timer_id);
+  size_t PickUpstream();
+
+private:
+  App& app_;
+  RedisProxyOptions options_;
+  asio::ip::tcp::acceptor acceptor_;
+  // before upstreams_: pending upstream callbacks keep connections alive
+  std::unordered_set<Connection*> conns_;
+  std::vector<Upstream> upstreams_;
+  RedisProxyStats stats_;
+};
@@ -0,0 +1,268 @@
+#include "redis_server.h"
+#include <algorithm>
+#include <cctype>
+#include <vector>
+
+static RedisMessage MakeError(std::string msg)
+{
+  return RedisMessage{std::in_place_index<2>, std::move(msg)};
+}
+
+static std::string ToUpper(std::string_view name)
+{
+  std::string upper(name);
+  std::transform(upper.begin(), upper.end(), upper.begin(),
+    [](unsigned char c) { return static_cast<char>(std::toupper(c)); });
+  return upper;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// RedisServerConnection
+class RedisServerConnection : public RESPConnection
+{
+public:
+  RedisServerConnection(RedisServer* server, asio::ip::tcp::socket socket)
+    : RESPConnection(std::move(socket), server->max_pending_replies_,
+        server->max_request_size_)
+    , server_(server)
+  {
+    server_->conns_.insert(this);
+  }
+
+  ~RedisServerConnection()
+  {
+    if (server_)
+    {
+      server_->conns_.erase(this);
+    }
+  }
+
+  // The server is going away; requests still held by handlers may keep
+  // the connection alive past it.
+  void Detach() { server_ = nullptr; }
+
+  void Complete(ReplySlot* slot, const RedisMessage& reply)
+  {
+    Fill(slot, RESPEncoder().Encode(reply));
+  }
+
+private:
+  void HandleRequest(
+    const RedisMessage& request, std::string_view raw) override
+  {
+    if (server_ == nullptr)
+    {
+      return;
+    }
+
+    ++server_->stats_.requests;
+
+    std::string name = CommandName(request);
+    if (name.empty())
+    {
+      ++server_->stats_.errors;
+      Reply(MakeError("ERR invalid request"));
+      return;
+    }
+
+    if (name == "QUIT")
+    {
+      Reply("+OK\r\n");
+      CloseAfterReplies();
+      return;
+    }
+
+    RedisServerRequest req;
+    req.state_ = std::make_shared<RedisServerRequest::State>();
+    req.state_->conn =
+      std::static_pointer_cast<RedisServerConnection>(shared_from_this());
+    req.state_->slot = Reserve();
+    req.state_->name = std::move(name);
+    req.state_->args = std::get<1>(std::get<3>(request).array);
+    server_->Dispatch(req);
+  }
+
+private:
+  RedisServer* server_;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// RedisServerRequest
+RedisServerRequest::State::~State()
+{
+  if (!slot->ready)
+  {
+    conn->Complete(slot, MakeError("ERR no reply for '" + name + "'"));
+  }
+}
+
+std::string_view RedisServerRequest::Arg(size_t index) const
+{
+  const RedisString* arg = std::get_if<1>(&state_->args[index]);
+  const std::string* str = arg ? std::get_if<1>(arg) : nullptr;
+  return str ? std::string_view(*str) : std::string_view();
+}
+
+void RedisServerRequest::Reply(const RedisMessage& reply) const
+{
+  state_->conn->Complete(state_->slot, reply);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// RedisServer
+RedisServer::RedisServer(App& app, const asio::ip::tcp::endpoint& listen,
+  size_t max_pending_replies, size_t max_request_size)
+  : app_(app)
+  , listen_(listen)
+  , max_pending_replies_(max_pending_replies)
+  , max_request_size_(max_request_size)
+  , acceptor_(app.IoCtx())
+{
+  RegisterCommand("PING", -1,
+    async::Bind<void(const RedisServerRequest&)>(&RedisServer::OnPing, this));
+  RegisterCommand("ECHO", 2,
+    async::Bind<void(const RedisServerRequest&)>(&RedisServer::OnEcho, this));
+  RegisterCommand("COMMAND", -1,
+    async::Bind<void(const RedisServerRequest&)>(
+      &RedisServer::OnCommand, this));
+}
+
+RedisServer::~RedisServer()
+{
+  Stop();
+  for (auto* conn : conns_)
+  {
+    conn->Detach();
+  }
+}
+
+void RedisServer::RegisterCommand(
+  std::string_view name, int arity, const RedisCommandHandler& handler)
+{
+  auto& command = commands_[ToUpper(name)];
+  command.arity = arity;
+  command.handler = handler;
+  command.co_handler = nullptr;
+}
+
+void RedisServer::RegisterCoCommand(
+  std::string_view name, int arity, const RedisCoCommandHandler& handler)
+{
+  auto& command = commands_[ToUpper(name)];
+  command.arity = arity;
+  command.handler = RedisCommandHandler();
+  command.co_handler = handler;
+}
+
+void RedisServer::Start()
+{
+  acceptor_.open(listen_.protocol());
+  acceptor_.set_option(asio::ip::tcp::acceptor::reuse_address(true));
+  acceptor_.bind(listen_);
+  acceptor_.listen();
+  Accept();
+}
+
+void RedisServer::Stop()
+{
+  std::error_code ec;
+  acceptor_.close(ec);
+
+  // Close may drop the last reference to a connection
+  std::vector<RedisServerConnection*> conns(conns_.begin(), conns_.end());
+  for (auto* conn : conns)
+  {
+    conn->Close();
+  }
+}
+
+RedisServerStats RedisServer::Stats() const
+{
+  RedisServerStats stats = stats_;
+  stats.connections = conns_.size();
+  return stats;
+}
+
+void RedisServer::Accept()
+{
+  acceptor_.async_accept(
+    [this](const std::error_code& ec, asio::ip::tcp::socket socket) {
+      if (ec)
+      {
+        return;
+      }
+
+      socket.set_option(asio::ip::tcp::no_delay(true));
+      auto conn =
+        std::make_shared<RedisServerConnection>(this, std::move(socket));
+      conn->Start();
+
+      Accept();
+    });
+}
+
+void RedisServer::Dispatch(const RedisServerRequest& request)
+{
+  auto it = commands_.find(request.Name());
+  if (it == commands_.end())
+  {
+    ++stats_.errors;
+    request.Reply(MakeError("ERR unknown command '" + request.Name() + "'"));
+    return;
+  }
+
+  const Command& command = it->second;
+  int argc = static_cast<int>(request.Size());
+  if ((command.arity >= 0 && argc != command.arity) ||
+      (command.arity < 0 && argc < -command.arity))
+  {
+    ++stats_.errors;
+    request.Reply(MakeError("ERR wrong number of arguments for '" +
+                            request.Name() + "' command"));
+    return;
+  }
+
+  if (command.co_handler)
+  {
+    async::CoSpawn(
+      &RedisServer::RunCoCommand, this, command.co_handler, request);
+  }
+  else
+  {
+    command.handler.Invoke(request);
+  }
+}
+
+async::CoTask<> RedisServer::RunCoCommand(
+  RedisCoCommandHandler handler, RedisServerRequest request)
+{
+  RedisMessage reply = co_await handler(request);
+  request.Reply(reply);
+}
+
+void RedisServer::OnPing(const RedisServerRequest& request)
+{
+  if (request.Size() > 1)
+  {
+    request.Reply(RedisMessage{
+      std::in_place_index<1>, RedisString{std::string(request.Arg(1))}});
+  }
+  else
+  {
+    request.Reply(
+      RedisMessage{std::in_place_index<1>, RedisString{std::string("PONG")}});
+  }
+}
+
+void RedisServer::OnEcho(const RedisServerRequest& request)
+{
+  request.Reply(RedisMessage{
+    std::in_place_index<1>, RedisString{std::string(request.Arg(1))}});
+}
+
+void RedisServer::OnCommand(const RedisServerRequest& request)
+{
+  // enough for redis-cli's handshake
+  request.Reply(RedisMessage{
+    std::in_place_index<3>, RedisArray{RedisArray::Elements{}}});
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include "app.h"
+#include "callback.h"
+#include "cotask.h"
+#include "resp_codec.h"
+#include "resp_connection.h"
+#include "thirtyparty/asio/asio.hpp"
+
+class RedisServerConnection;
+
+// A parsed request handed to a command handler. Copies share one reply:
+// the first Reply wins, and a request dropped without a reply is answered
+// with an error so later replies on the connection are not held up.
+class RedisServerRequest
+{
+public:
+  // upper-cased command name
+  const std::string& Name() const { return state_->name; }
+  // arguments, the command name included
+  size_t Size() const { return state_->args.size(); }
+  std::string_view Arg(size_t index) const;
+  const RedisArray::Elements& Args() const { return state_->args; }
+
+  void Reply(const RedisMessage& reply) const;
+
+private:
+  friend class RedisServerConnection;
+
+  struct State
+  {
+    ~State();
+
+    std::shared_ptr<RedisServerConnection> conn;
+    RESPConnection::ReplySlot* slot = nullptr;
+    std::string name;
+    RedisArray::Elements args;
+  };
+
+  std::shared_ptr<State> state_;
+};
+
+using RedisCommandHandler = async::Callback<void(const RedisServerRequest&)>;
+using RedisCoCommandHandler =
+  std::function<async::CoTask<RedisMessage>(RedisServerRequest)>;
+
+struct RedisServerStats
+{
+  size_t connections = 0;
+  uint64_t requests = 0;
+  uint64_t errors = 0;
+};
+
+// A RESP server on App. Requests are dispatched by command name to a
+// registered handler, either a callback that replies through the request,
+// now or later, or a coroutine whose result is the reply. Replies go back
+// in request order, those produced while handling a read in one write.
+// PING, ECHO, QUIT and COMMAND are built in.
+class RedisServer : public async::CallbackHost
+{
+public:
+  RedisServer(App& app, const asio::ip::tcp::endpoint& listen,
+    size_t max_pending_replies = 1024,
+    size_t max_request_size = RESPConnection::kDefaultMaxRequestSize);
+  ~RedisServer();
+
+  // arity counts the command name; negative means at least -arity
+  void RegisterCommand(
+    std::string_view name, int arity, const RedisCommandHandler& handler);
+  void RegisterCoCommand(
+    std::string_view name, int arity, const RedisCoCommandHandler& handler);
+
+  void Start();
+  void Stop();
+
+  RedisServerStats Stats() const;
+
+private:
+  friend class RedisServerConnection;
+
+  struct Command
+  {
+    int arity = 0;
+    RedisCommandHandler handler;
+    RedisCoCommandHandler co_handler;
+  };
+
+  void Accept();
+  void Dispatch(const RedisServerRequest& request);
+  async::CoTask<> RunCoCommand(
+    RedisCoCommandHandler handler, RedisServerRequest request);
+
+  void OnPing(const RedisServerRequest& request);
+  void OnEcho(const RedisServerRequest& request);
+  void OnCommand(const RedisServerRequest& request);
+
+private:
+  App& app_;
+  asio::ip::tcp::endpoint listen_;
+  size_t max_pending_replies_;
+  size_t max_request_size_;
+  asio::ip::tcp::acceptor acceptor_;
+  std::unordered_map<std::string, Command> commands_;
+  std::unordered_set<RedisServerConnection*> conns_;
+  RedisServerStats stats_;
+};
@@ -0,0 +1,383 @@
+#include "redis_stream_consumer.h"
+#include <algorithm>
+#include <charconv>
+#include <memory>
+#include "redis_awaiter.h"
+
+template <typename Variant>
+static const std::string* AsString(const Variant& message)
+{
+  const RedisString* str = std::get_if<1>(&message);
+  return str ? std::get_if<std::string>(str) : nullptr;
+}
+
+template <typename Variant>
+static const RedisArray::Elements* AsArray(const Variant& message)
+{
+  const RedisArray* array = std::get_if<3>(&message);
+  return array ? std::get_if<1>(&array->array) : nullptr;
+}
+
+// A failed command, or an error reply starting with code.
+static bool IsError(const ZResult<RedisMessage>& reply, std::string_view code)
+{
+  if (!reply)
+  {
+    return true;
+  }
+
+  const RedisError* error = std::get_if<2>(&reply.Value());
+  return error && error->compare(0, code.size(), code) == 0;
+}
+
+RedisStreamConsumer::RedisStreamConsumer(App& app, LaneRedisClient& client,
+  const StreamConsumerOptions& options, StreamEntryHandler handler)
+  : app_(app)
+  , client_(client)
+  , options_(options)
+  , handler_(std::move(handler))
+  , running_(false)
+  , looping_(false)
+  , group_ready_(false)
+  , paused_(nullptr)
+  , ack_timer_()
+  , claim_timer_()
+  , timers_started_(false)
+  , resume_at_(0)
+  , claim_cursor_("0-0")
+{
+  options_.max_inflight = std::max<size_t>(options_.max_inflight, 1);
+  options_.count = std::max<size_t>(options_.count, 1);
+  // read again once a sizeable batch fits, not one entry at a time
+  resume_at_ = options_.max_inflight -
+               std::min(options_.count,
+                 std::max<size_t>(options_.max_inflight / 2, 1));
+}
+
+RedisStreamConsumer::~RedisStreamConsumer()
+{
+  if (timers_started_)
+  {
+    app_.RemoveTimer(ack_timer_);
+    app_.RemoveTimer(claim_timer_);
+  }
+  FlushAcks();
+}
+
+void RedisStreamConsumer::Start()
+{
+  running_ = true;
+  if (!timers_started_)
+  {
+    timers_started_ = true;
+    ack_timer_ = app_.AddPeriodTimer(options_.ack_interval,
+      async::Bind<void(TickTimerID)>(&RedisStreamConsumer::OnAckTimer, this));
+    claim_timer_ = app_.AddPeriodTimer(options_.claim_interval,
+      async::Bind<void(TickTimerID)>(
+        &RedisStreamConsumer::OnClaimTimer, this));
+  }
+
+  if (!looping_)
+  {
+    async::CoSpawn(&RedisStreamConsumer::Run, this);
+  }
+}
+
+void RedisStreamConsumer::Stop()
+{
+  running_ = false;
+  Wake();
+}
+
+StreamConsumerStats RedisStreamConsumer::Stats() const
+{
+  StreamConsumerStats stats = stats_;
+  stats.unacked = acks_.size();
+  return stats;
+}
+
+async::CoTask<> RedisStreamConsumer::Run()
+{
+  looping_ = true;
+  std::string_view stream(options_.stream);
+  std::string_view group(options_.group);
+  std::string_view consumer(options_.consumer);
+  std::string_view start_id(options_.start_id);
+  const std::string block = std::to_string(options_.block.count());
+
+  // every pause is followed by checking the loop's conditions again
+  while (running_)
+  {
+    if (!group_ready_)
+    {
+      std::vector<RedisArg> create{
+        "XGROUP", "CREATE", stream, group, start_id, "MKSTREAM"};
+      auto reply = co_await CoCommand(client_, std::move(create));
+      group_ready_ = !IsError(reply, "") || IsError(reply, "BUSYGROUP");
+      if (!group_ready_)
+      {
+        app_.AddOneshotTimer(options_.retry_delay,
+          async::Bind<void(TickTimerID)>(
+            &RedisStreamConsumer::OnRetryTimer, this));
+        co_await Pause{this};
+        continue;
+      }
+    }
+
+    if (stats_.inflight > resume_at_)
+    {
+      co_await Pause{this};
+      continue;
+    }
+
+    const std::string count = std::to_string(
+      std::min(options_.count, options_.max_inflight - stats_.inflight));
+    ++stats_.reads;
+    std::vector<RedisArg> read{"XREADGROUP", "GROUP", group, consumer,
+      "COUNT", std::string_view(count), "BLOCK", std::string_view(block),
+      "STREAMS", stream, ">"};
+    auto reply = co_await CoCommand(client_, std::move(read));
+    if (IsError(reply, ""))
+    {
+      // the stream was deleted along with the group
+      if (IsError(reply, "NOGROUP"))
+      {
+        group_ready_ = false;
+      }
+      app_.AddOneshotTimer(options_.retry_delay,
+        async::Bind<void(TickTimerID)>(
+          &RedisStreamConsumer::OnRetryTimer, this));
+      co_await Pause{this};
+      continue;
+    }
+
+    // [[stream, [entry, ...]]], nil once BLOCK expires
+    const RedisArray::Elements* streams = AsArray(reply.Value());
+    if (streams)
+    {
+      for (const auto& element : *streams)
+      {
+        const RedisArray::Elements* pair = AsArray(element);
+        if (pair && pair->size() == 2)
+        {
+          Dispatch((*pair)[1], false);
+        }
+      }
+    }
+  }
+  looping_ = false;
+}
+
+size_t RedisStreamConsumer::Dispatch(
+  const RedisArray::Element& entries, bool claimed)
+{
+  const RedisArray::Elements* list = AsArray(entries);
+  if (list == nullptr)
+  {
+    return 0;
+  }
+
+  size_t dispatched = 0;
+  for (const auto& element : *list)
+  {
+    // [id, [field, value, ...]]; claimed entries since deleted have no
+    // fields and are dropped from the pending list by XAUTOCLAIM itself;
+    // entries this consumer is still handling are skipped
+    const RedisArray::Elements* entry = AsArray(element);
+    const std::string* id =
+      entry && entry->size() == 2 ? AsString((*entry)[0]) : nullptr;
+    const RedisArray::Elements* fields = id ? AsArray((*entry)[1]) : nullptr;
+    if (fields == nullptr || !inflight_ids_.insert(*id).second)
+    {
+      continue;
+    }
+
+    StreamEntry stream_entry;
+    stream_entry.id = *id;
+    for (size_t i = 0; i + 1 < fields->size(); i += 2)
+    {
+      const std::string* field = AsString((*fields)[i]);
+      const std::string* value = AsString((*fields)[i + 1]);
+      stream_entry.fields.emplace_back(
+        field ? *field : std::string(), value ? *value : std::string());
+    }
+
+    if (!claimed)
+    {
+      // ids start with the entry's creation time in milliseconds
+      int64_t created = 0;
+      std::from_chars(id->data(), id->data() + id->size(), created);
+      int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch())
+                      .count();
+      stats_.delivery_lag =
+        std::chrono::milliseconds{std::max<int64_t>(now - created, 0)};
+    }
+
+    ++dispatched;
+    ++stats_.entries;
+    ++stats_.inflight;
+    async::CoSpawn(
+      &RedisStreamConsumer::Handle, this, std::move(stream_entry));
+  }
+
+  if (claimed)
+  {
+    stats_.claimed += dispatched;
+  }
+  return dispatched;
+}
+
+async::CoTask<> RedisStreamConsumer::Handle(StreamEntry entry)
+{
+  std::string id = entry.id;
+  bool ok = co_await handler_(std::move(entry));
+
+  inflight_ids_.erase(id);
+  --stats_.inflight;
+  if (ok)
+  {
+    ++stats_.handled;
+    acks_.push_back(std::move(id));
+    if (acks_.size() >= options_.ack_batch)
+    {
+      FlushAcks();
+    }
+  }
+  else
+  {
+    ++stats_.failed;
+  }
+
+  if (stats_.inflight == resume_at_)
+  {
+    Wake();
+  }
+}
+
+void RedisStreamConsumer::Wake()
+{
+  if (paused_ == nullptr)
+  {
+    return;
+  }
+
+  auto frame = paused_;
+  paused_ = nullptr;
+  frame->Resume();
+}
+
+void RedisStreamConsumer::FlushAcks()
+{
+  if (acks_.empty())
+  {
+    return;
+  }
+
+  auto ids = std::make_shared<std::vector<std::string>>(std::move(acks_));
+  acks_.clear();
+
+  std::vector<RedisArg> args;
+  args.reserve(ids->size() + 3);
+  args.emplace_back("XACK");
+  args.emplace_back(std::string_view(options_.stream));
+  args.emplace_back(std::string_view(options_.group));
+  for (const auto& id : *ids)
+  {
+    args.emplace_back(id, ids);
+  }
+  client_.Command(args,
+    async::Bind<void(const ZResult<RedisMessage>&)>(
+      &RedisStreamConsumer::OnAckReply, this));
+}
+
+void RedisStreamConsumer::OnAckReply(const ZResult<RedisMessage>& reply)
+{
+  if (reply && reply.Value().index() == 0)
+  {
+    stats_.acked += std::get<0>(reply.Value());
+  }
+}
+
+void RedisStreamConsumer::OnAckTimer(TickTimerID timer_id)
+{
+  FlushAcks();
+}
+
+void RedisStreamConsumer::OnClaimTimer(TickTimerID timer_id)
+{
+  std::string_view stream(options_.stream);
+  std::string_view group(options_.group);
+  client_.Command({"XPENDING", stream, group},
+    async::Bind<void(const ZResult<RedisMessage>&)>(
+      &RedisStreamConsumer::OnPendingReply, this));
+
+  if (!running_ || !group_ready_ ||
+      stats_.inflight >= options_.max_inflight)
+  {
+    return;
+  }
+
+  auto args = std::make_shared<std::vector<std::string>>(
+    std::initializer_list<std::string>{
+      std::to_string(options_.min_idle.count()), claim_cursor_,
+      std::to_string(std::min(options_.claim_count,
+        options_.max_inflight - stats_.inflight))});
+  client_.Command({"XAUTOCLAIM", stream, group,
+                    std::string_view(options_.consumer), {(*args)[0], args},
+                    {(*args)[1], args}, "COUNT", {(*args)[2], args}},
+    async::Bind<void(const ZResult<RedisMessage>&)>(
+      &RedisStreamConsumer::OnClaimReply, this));
+}
+
+void RedisStreamConsumer::OnClaimReply(const ZResult<RedisMessage>& reply)
+{
+  // [next cursor, [entry, ...], [deleted id, ...]]
+  const RedisArray::Elements* elements =
+    reply ? AsArray(reply.Value()) : nullptr;
+  if (elements == nullptr || elements->size() < 2)
+  {
+    return;
+  }
+
+  const std::string* cursor = AsString((*elements)[0]);
+  claim_cursor_ = cursor ? *cursor : "0-0";
+  Dispatch((*elements)[1], true);
+}
+
+void RedisStreamConsumer::OnPendingReply(const ZResult<RedisMessage>& reply)
+{
+  // [count, min id, max id, [[consumer, count], ...]]
+  const RedisArray::Elements* elements =
+    reply ? AsArray(reply.Value()) : nullptr;
+  if (elements == nullptr || elements->size() < 4)
+  {
+    return;
+  }
+
+  stats_.pending.clear();
+  const RedisArray::Elements* consumers = AsArray((*elements)[3]);
+  if (consumers == nullptr)
+  {
+    return;
+  }
+
+  for (const auto& element : *consumers)
+  {
+    const RedisArray::Elements* pair = AsArray(element);
+    const std::string* name =
+      pair && pair->size() == 2 ? AsString((*pair)[0]) : nullptr;
+    const std::string* count = name ? AsString((*pair)[1]) : nullptr;
+    if (count)
+    {
+      uint64_t value = 0;
+      std::from_chars(count->data(), count->data() + count->size(), value);
+      stats_.pending.emplace_back(*name, value);
+    }
+  }
+}
+
+void RedisStreamConsumer::OnRetryTimer(TickTimerID timer_id)
+{
+  Wake();
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include "app.h"
+#include "callback.h"
+#include "cotask.h"
+#include "lane_redis_client.h"
+
+struct StreamEntry
+{
+  std::string id;
+  std::vector<std::pair<std::string, std::string>> fields;
+};
+
+// Processes one entry; true acknowledges it. An entry left unacknowledged
+// stays pending and is claimed again once idle for min_idle.
+using StreamEntryHandler =
+  std::function<async::CoTask<bool>(StreamEntry)>;
+
+struct StreamConsumerOptions
+{
+  std::string stream;
+  std::string group;
+  std::string consumer;
+  // XGROUP CREATE ... MKSTREAM from this id if the group does not exist
+  std::string start_id = "$";
+  // XREADGROUP COUNT and BLOCK
+  size_t count = 64;
+  std::chrono::milliseconds block{2000};
+  // entries handed to the handler and not finished yet, at most
+  size_t max_inflight = 64;
+  // XACK once this many entries are done, or every ack_interval
+  size_t ack_batch = 64;
+  std::chrono::milliseconds ack_interval{100};
+  // XAUTOCLAIM entries idle for min_idle, up to claim_count every
+  // claim_interval, which also polls XPENDING for the stats
+  std::chrono::milliseconds claim_interval{30000};
+  std::chrono::milliseconds min_idle{60000};
+  size_t claim_count = 100;
+  // wait before reading again after an error
+  std::chrono::milliseconds retry_delay{1000};
+};
+
+struct StreamConsumerStats
+{
+  uint64_t reads = 0;
+  // entries handed to the handler, read or claimed
+  uint64_t entries = 0;
+  uint64_t claimed = 0;
+  uint64_t handled = 0;
+  // handler returned false, left pending
+  uint64_t failed = 0;
+  // acknowledged by XACK replies
+  uint64_t acked = 0;
+  size_t inflight = 0;
+  // done and waiting for the next XACK
+  size_t unacked = 0;
+  // now minus the time in the id of the newest entry read
+  std::chrono::milliseconds delivery_lag{0};
+  // pending entries of each consumer in the group, as of the last poll
+  std::vector<std::pair<std::string, uint64_t>> pending;
+};
+
+// Consumer group member running as a CoTask loop: XREADGROUP reads a batch
+// (on the client's blocking lane), each entry goes to the handler as its
+// own coroutine, and reading pauses while max_inflight entries are being
+// handled, until half of them are done. Acknowledgements are batched into
+// pipelined XACKs. Entries other consumers left pending too long are taken
+// over with XAUTOCLAIM on an App timer.
+class RedisStreamConsumer : public async::CallbackHost
+{
+public:
+  RedisStreamConsumer(App& app, LaneRedisClient& client,
+    const StreamConsumerOptions& options, StreamEntryHandler handler);
+  // Sends the acknowledgements still batched.
+  ~RedisStreamConsumer();
+
+  void Start();
+  // Stops reading once the current XREADGROUP returns; entries already
+  // read are still handled and acknowledged.
+  void Stop();
+
+  StreamConsumerStats Stats() const;
+
+private:
+  // Suspends the read loop until Wake.
+  struct Pause
+  {
+    RedisStreamConsumer* consumer;
+
+    bool await_ready() const { return false; }
+    template <typename P>
+    void await_suspend(std::experimental::coroutine_handle<P> coroutine)
+    {
+      consumer->paused_ = &coroutine.promise();
+    }
+    void await_resume() {}
+  };
+
+  async::CoTask<> Run();
+  async::CoTask<> Handle(StreamEntry entry);
+  // Hands the entries of an XREADGROUP or XAUTOCLAIM reply to the handler,
+  // returns how many there were.
+  size_t Dispatch(const RedisArray::Element& entries, bool claimed);
+  void Wake();
+
+  void FlushAcks();
+  void OnAckReply(const ZResult<RedisMessage>& reply);
+  void OnAckTimer(TickTimerID timer_id);
+  void OnClaimTimer(TickTimerID timer_id);
+  void OnClaimReply(const ZResult<RedisMessage>& reply);
+  void OnPendingReply(const ZResult<RedisMessage>& reply);
+  void OnRetryTimer(TickTimerID timer_id);
+
+private:
+  App& app_;
+  LaneRedisClient& client_;
+  StreamConsumerOptions options_;
+  StreamEntryHandler handler_;
+  bool running_;
+  bool looping_;
+  bool group_ready_;
+  async::detail::CoFrameBase* paused_;
+  TickTimerID ack_timer_;
+  TickTimerID claim_timer_;
+  bool timers_started_;
+  // reading resumes once no more than this many entries are in flight
+  size_t resume_at_;
+  // XAUTOCLAIM resumes from here, 0-0 after a full pass
+  std::string claim_cursor_;
+  // ids of the entries being handled; XAUTOCLAIM returns them again once
+  // a handler runs longer than min_idle
+  std::unordered_set<std::string> inflight_ids_;
+  std::vector<std::string> acks_;
+  StreamConsumerStats stats_;
+};
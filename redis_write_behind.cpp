@@ -0,0 +1,265 @@
+#include "redis_write_behind.h"
+#include <algorithm>
+#include <charconv>
+#include <limits>
+
+RedisWriteBehind::RedisWriteBehind(
+  App& app, RedisClient& client, const WriteBehindOptions& options)
+  : app_(app)
+  , client_(client)
+  , options_(options)
+  , pending_(0)
+{
+  options_.max_pending = std::max<size_t>(options_.max_pending, 1);
+  flush_timer_ = app_.AddPeriodTimer(options_.max_staleness,
+    async::Bind<void(TickTimerID)>(&RedisWriteBehind::OnFlushTimer, this));
+}
+
+RedisWriteBehind::~RedisWriteBehind()
+{
+  app_.RemoveTimer(flush_timer_);
+  Flush();
+}
+
+bool RedisWriteBehind::AddDelta(int64_t& pending, int64_t delta)
+{
+  if ((delta > 0 &&
+        pending > std::numeric_limits<int64_t>::max() - delta) ||
+      (delta < 0 && pending < std::numeric_limits<int64_t>::min() - delta))
+  {
+    return false;
+  }
+
+  pending += delta;
+  return true;
+}
+
+void RedisWriteBehind::IncrBy(std::string_view key, int64_t delta)
+{
+  std::string name(key);
+  if (hashes_.count(name))
+  {
+    Flush();
+  }
+
+  auto it = values_.find(name);
+  if (it != values_.end())
+  {
+    Value& value = it->second;
+    int64_t number = 0;
+    bool folded = false;
+    if (value.set)
+    {
+      // fold into the SET while the value is an integer in the form Redis
+      // accepts for INCRBY; "01" or "-0" must fail there, not here
+      const char* end = value.value.data() + value.value.size();
+      auto [ptr, ec] = std::from_chars(value.value.data(), end, number);
+      folded = ec == std::errc() && ptr == end &&
+               std::to_string(number) == value.value &&
+               AddDelta(number, delta);
+      if (folded)
+      {
+        value.value = std::to_string(number);
+      }
+    }
+    else
+    {
+      folded = AddDelta(value.delta, delta);
+    }
+
+    if (folded)
+    {
+      ++stats_.writes;
+      return;
+    }
+    // a non-integer SET or an overflowing sum goes to the server as is
+    Flush();
+  }
+
+  values_[name].delta = delta;
+  ++pending_;
+  Written();
+}
+
+void RedisWriteBehind::HIncrBy(
+  std::string_view key, std::string_view field, int64_t delta)
+{
+  std::string name(key);
+  if (values_.count(name))
+  {
+    Flush();
+  }
+
+  auto& fields = hashes_[name];
+  auto it = fields.find(std::string(field));
+  if (it != fields.end())
+  {
+    if (AddDelta(it->second, delta))
+    {
+      ++stats_.writes;
+      return;
+    }
+    Flush();
+    // the flush took the hash and its fields out of hashes_
+    hashes_[name].emplace(std::string(field), delta);
+  }
+  else
+  {
+    fields.emplace(std::string(field), delta);
+  }
+  ++pending_;
+  Written();
+}
+
+void RedisWriteBehind::Set(std::string_view key, std::string_view value)
+{
+  std::string name(key);
+  if (hashes_.count(name))
+  {
+    Flush();
+  }
+
+  auto [it, inserted] = values_.try_emplace(std::move(name));
+  // the SET overwrites whatever was pending for the key
+  it->second.set = true;
+  it->second.value.assign(value);
+  it->second.delta = 0;
+  if (!inserted)
+  {
+    ++stats_.writes;
+    return;
+  }
+  ++pending_;
+  Written();
+}
+
+void RedisWriteBehind::Written()
+{
+  ++stats_.writes;
+  if (pending_ >= options_.max_pending)
+  {
+    Flush();
+  }
+}
+
+void RedisWriteBehind::OnFlushTimer(TickTimerID timer_id)
+{
+  Flush();
+}
+
+void RedisWriteBehind::Flush(const FlushCallback& cb_done)
+{
+  if (pending_ == 0)
+  {
+    if (flushing_.empty())
+    {
+      cb_done.Invoke(RCE_SUCCESS);
+      return;
+    }
+
+    auto barrier = std::make_shared<FlushState>();
+    barrier->barrier = true;
+    barrier->callback = cb_done;
+    flushing_.push_back(std::move(barrier));
+    return;
+  }
+
+  ++stats_.flushes;
+  auto state = std::make_shared<FlushState>();
+  state->callback = cb_done;
+  flushing_.push_back(state);
+  auto values = std::make_shared<decltype(values_)>(std::move(values_));
+  auto hashes = std::make_shared<decltype(hashes_)>(std::move(hashes_));
+  values_.clear();
+  hashes_.clear();
+  state->pending = pending_;
+  pending_ = 0;
+
+  // all commands are queued in this call and go out as one pipelined write;
+  // the maps own the argument bytes until the replies are in
+  CommandCallback cb_reply = async::Bind<void(const ZResult<RedisMessage>&)>(
+    &RedisWriteBehind::OnReply, this, state);
+  for (const auto& [key, value] : *values)
+  {
+    std::vector<RedisArg> args;
+    if (value.set)
+    {
+      args = {"SET", {key, values}, {value.value, values}};
+    }
+    else
+    {
+      auto delta =
+        std::make_shared<const std::string>(std::to_string(value.delta));
+      args = {"INCRBY", {key, values}, std::move(delta)};
+    }
+    ++stats_.commands;
+    client_.Command(args, cb_reply);
+  }
+
+  for (const auto& [key, fields] : *hashes)
+  {
+    for (const auto& [field, delta] : fields)
+    {
+      std::vector<RedisArg> args{"HINCRBY", {key, hashes}, {field, hashes},
+        std::make_shared<const std::string>(std::to_string(delta))};
+      ++stats_.commands;
+      client_.Command(args, cb_reply);
+    }
+  }
+}
+
+void RedisWriteBehind::OnReply(
+  std::shared_ptr<FlushState> state, const ZResult<RedisMessage>& reply)
+{
+  int error = RCE_SUCCESS;
+  if (!reply)
+  {
+    error = reply.Error();
+  }
+  else if (reply.Value().index() == 2)
+  {
+    error = RCE_WRITEFAILED;
+  }
+
+  if (error != RCE_SUCCESS)
+  {
+    ++stats_.failed;
+    if (state->error == RCE_SUCCESS)
+    {
+      state->error = error;
+    }
+  }
+
+  if (--state->pending == 0)
+  {
+    CompleteFlushes();
+  }
+}
+
+void RedisWriteBehind::CompleteFlushes()
+{
+  while (!flushing_.empty() && flushing_.front()->pending == 0)
+  {
+    auto state = std::move(flushing_.front());
+    flushing_.pop_front();
+    if (state->error != RCE_SUCCESS)
+    {
+      // barriers behind it wait for it, so they report its failure
+      for (auto& later : flushing_)
+      {
+        if (later->barrier && later->error == RCE_SUCCESS)
+        {
+          later->error = state->error;
+        }
+      }
+    }
+    state->callback.Invoke(state->error);
+  }
+}
+
+WriteBehindStats RedisWriteBehind::Stats() const
+{
+  WriteBehindStats stats = stats_;
+  stats.pending = pending_;
+  return stats;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include "app.h"
+#include "callback.h"
+#include "redis_client.h"
+
+// a write of the flush was answered with an error reply
+#define RCE_WRITEFAILED 6
+
+struct WriteBehindOptions
+{
+  // pending writes are flushed at least this often, which bounds how far
+  // behind the server is
+  std::chrono::milliseconds max_staleness{100};
+  // flush as soon as this many keys and hash fields have pending writes
+  size_t max_pending = 10000;
+};
+
+struct WriteBehindStats
+{
+  uint64_t writes = 0;
+  uint64_t commands = 0;
+  uint64_t flushes = 0;
+  // commands that failed; their writes may or may not have been applied
+  uint64_t failed = 0;
+  size_t pending = 0;
+};
+
+// Called once every command of a flush, and of every flush before it, has
+// been answered, with RCE_SUCCESS or the first error. With nothing pending
+// Flush is a barrier behind the flushes still in flight, and reports the
+// first error among them.
+using FlushCallback = async::Callback<void(int)>;
+
+// Write-behind aggregator over a RedisClient. INCRBY and HINCRBY deltas
+// to the same key (and field) are summed and SETs keep only the last
+// value; a SET followed by INCRBY of an integer value folds into one SET.
+// Pending writes go out as one pipelined batch on a period timer, when
+// max_pending is reached, or on Flush. A string write to a key with
+// pending hash writes, or the other way round, flushes first so the
+// server sees them in order. Writes to different keys may be reordered.
+class RedisWriteBehind : public async::CallbackHost
+{
+public:
+  RedisWriteBehind(App& app, RedisClient& client,
+    const WriteBehindOptions& options = WriteBehindOptions{});
+  // Flushes what is still pending.
+  ~RedisWriteBehind();
+
+  void IncrBy(std::string_view key, int64_t delta);
+  void HIncrBy(std::string_view key, std::string_view field, int64_t delta);
+  void Set(std::string_view key, std::string_view value);
+
+  void Flush(const FlushCallback& cb_done = FlushCallback());
+
+  WriteBehindStats Stats() const;
+
+private:
+  struct Value
+  {
+    // a SET of value, followed by delta when value is an integer
+    bool set = false;
+    std::string value;
+    int64_t delta = 0;
+  };
+
+  struct FlushState
+  {
+    size_t pending = 0;
+    int error = RCE_SUCCESS;
+    // nothing of its own to write, waits for the flushes before it
+    bool barrier = false;
+    FlushCallback callback;
+  };
+
+  // Sums the delta into pending, false if it would overflow.
+  static bool AddDelta(int64_t& pending, int64_t delta);
+  void Written();
+  void OnFlushTimer(TickTimerID timer_id);
+  void OnReply(std::shared_ptr<FlushState> state,
+    const ZResult<RedisMessage>& reply);
+  void CompleteFlushes();
+
+private:
+  App& app_;
+  RedisClient& client_;
+  WriteBehindOptions options_;
+  TickTimerID flush_timer_;
+  std::unordered_map<std::string, Value> values_;
+  std::unordered_map<std::string, std::unordered_map<std::string, int64_t>>
+    hashes_;
+  size_t pending_;
+  // flushes in flight, completed in order
+  std::deque<std::shared_ptr<FlushState>> flushing_;
+  WriteBehindStats stats_;
+};
@@ -0,0 +1,451 @@
+#include "replica_redis_client.h"
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+#include "redis_command.h"
+
+#define LATENCY_WINDOW 1024
+// recompute the hedge delay every this many samples
+#define LATENCY_REFRESH 128
+
+// Value of "name:value" in an INFO reply, empty if absent.
+static std::string_view InfoField(std::string_view info, std::string_view name)
+{
+  while (!info.empty())
+  {
+    size_t end = info.find("\r\n");
+    std::string_view line = info.substr(0, end);
+    info = end == std::string_view::npos ? std::string_view()
+                                         : info.substr(end + 2);
+    if (line.size() > name.size() && line[name.size()] == ':' &&
+        line.substr(0, name.size()) == name)
+    {
+      return line.substr(name.size() + 1);
+    }
+  }
+  return {};
+}
+
+// A copy of args whose long arguments, which RedisClient writes from the
+// caller's memory, are owned: a hedge leg may still be queued after the
+// caller's callback has run.
+static std::vector<RedisArg> OwnArgs(const std::vector<RedisArg>& args)
+{
+  std::vector<RedisArg> owned(args);
+  for (auto& arg : owned)
+  {
+    if (arg.owner || arg.data.size() < RESPEncoder::kGatherThreshold)
+    {
+      continue;
+    }
+
+    auto buffer = std::make_shared<const std::string>(arg.data);
+    arg = RedisArg(std::move(buffer));
+  }
+  return owned;
+}
+
+static int64_t InfoInteger(std::string_view info, std::string_view name)
+{
+  std::string value(InfoField(info, name));
+  return value.empty() ? -1 : std::strtoll(value.c_str(), nullptr, 10);
+}
+
+ReplicaRedisClient::ReplicaRedisClient(
+  App& app, const ReplicaRoutingOptions& options)
+  : app_(app)
+  , options_(options)
+  , nodes_(1)
+  , latency_pos_(0)
+  , hedge_delay_(0)
+{
+  check_timer_ = app_.AddPeriodTimer(options_.check_interval,
+    async::Bind<void(TickTimerID)>(&ReplicaRedisClient::OnCheckTimer, this));
+}
+
+ReplicaRedisClient::~ReplicaRedisClient()
+{
+  app_.RemoveTimer(check_timer_);
+  // fail pending commands while the rest of the client is still alive
+  for (auto& node : nodes_)
+  {
+    node.client.reset();
+  }
+}
+
+void ReplicaRedisClient::SetPrimary(const asio::ip::tcp::endpoint& server)
+{
+  nodes_[0].server = server;
+  Connect(0);
+}
+
+void ReplicaRedisClient::AddReplica(const asio::ip::tcp::endpoint& server)
+{
+  nodes_.emplace_back().server = server;
+  Connect(nodes_.size() - 1);
+}
+
+void ReplicaRedisClient::Connect(size_t index)
+{
+  Node& node = nodes_[index];
+  node.client = std::make_unique<RedisClient>(app_,
+    async::Bind<void(int)>(&ReplicaRedisClient::OnConnected, this, index),
+    async::Bind<void()>(&ReplicaRedisClient::OnDisconnect, this, index),
+    options_.pipeline);
+  if (options_.health_check)
+  {
+    node.client->EnableHealthCheck(options_.health);
+  }
+  node.client->Connect(node.server);
+}
+
+void ReplicaRedisClient::Command(
+  const std::vector<RedisArg>& args, const CommandCallback& cb_cmd)
+{
+  const RedisCommandInfo* info =
+    args.empty() ? nullptr : LookupRedisCommand(args[0].data);
+  if (info == nullptr || !(info->flags & kRedisCmdRead) ||
+      (info->flags & kRedisCmdBlocking))
+  {
+    ++stats_.writes;
+    CommandPrimary(args, cb_cmd);
+    return;
+  }
+
+  size_t index = PickReplica();
+  if (index == 0)
+  {
+    ++stats_.fallback_reads;
+    CommandPrimary(args, cb_cmd);
+    return;
+  }
+
+  ++stats_.replica_reads;
+  if (options_.hedge.enabled)
+  {
+    HedgedRead(index, args, cb_cmd);
+    return;
+  }
+
+  Node& node = nodes_[index];
+  ++node.outstanding;
+  ++node.reads;
+  node.client->Command(args,
+    async::Bind<void(const ZResult<RedisMessage>&)>(&ReplicaRedisClient::OnRead,
+      this, index, std::chrono::steady_clock::now(), cb_cmd));
+}
+
+void ReplicaRedisClient::CommandPrimary(
+  const std::vector<RedisArg>& args, const CommandCallback& cb_cmd)
+{
+  if (!nodes_[0].client)
+  {
+    cb_cmd.Invoke(ZResult<RedisMessage>(Failure(RCE_DISCONNECTED)));
+    return;
+  }
+  nodes_[0].client->Command(args, cb_cmd);
+}
+
+// Index of the replica to read from, other than exclude, 0 (the primary)
+// if none is usable.
+size_t ReplicaRedisClient::PickReplica(size_t exclude) const
+{
+  size_t best = 0;
+  double best_cost = 0;
+  for (size_t i = 1; i < nodes_.size(); ++i)
+  {
+    const Node& node = nodes_[i];
+    if (i == exclude || !node.client || !node.connected || !node.fresh ||
+        !node.client->Healthy())
+    {
+      continue;
+    }
+
+    // replicas without a sample yet are tried first; latency is weighed
+    // by the queue it would join
+    double cost = static_cast<double>(node.outstanding);
+    if (options_.selection == ReplicaSelection::kLowestLatency)
+    {
+      cost = node.latency < 0 ? -1 : node.latency * (node.outstanding + 1);
+    }
+
+    if (best == 0 || cost < best_cost ||
+        (cost == best_cost && node.latency < nodes_[best].latency))
+    {
+      best = i;
+      best_cost = cost;
+    }
+  }
+  return best;
+}
+
+void ReplicaRedisClient::OnRead(size_t index,
+  std::chrono::steady_clock::time_point start, CommandCallback cb_cmd,
+  const ZResult<RedisMessage>& reply)
+{
+  Node& node = nodes_[index];
+  --node.outstanding;
+  if (reply)
+  {
+    Sample(node, start);
+  }
+  cb_cmd.Invoke(reply);
+}
+
+void ReplicaRedisClient::Sample(
+  Node& node, std::chrono::steady_clock::time_point start)
+{
+  Sample(node, std::chrono::duration<double, std::micro>(
+                 std::chrono::steady_clock::now() - start)
+                 .count());
+}
+
+void ReplicaRedisClient::Sample(Node& node, double micros)
+{
+  node.latency = node.latency < 0
+                   ? micros
+                   : node.latency +
+                       options_.latency_alpha * (micros - node.latency);
+}
+
+void ReplicaRedisClient::HedgedRead(size_t index,
+  const std::vector<RedisArg>& args, const CommandCallback& cb_cmd)
+{
+  auto hedge = std::make_shared<Hedge>();
+  hedge->args = OwnArgs(args);
+  hedge->callback = cb_cmd;
+  hedge->first = index;
+  SendLeg(index, hedge);
+
+  hedge->timer = app_.AddOneshotTimer(HedgeDelay(),
+    async::Bind<void(TickTimerID)>(
+      &ReplicaRedisClient::OnHedgeTimer, this, hedge));
+  hedge->timer_pending = true;
+}
+
+void ReplicaRedisClient::SendLeg(
+  size_t index, const std::shared_ptr<Hedge>& hedge)
+{
+  Node& node = nodes_[index];
+  ++node.outstanding;
+  ++node.reads;
+  ++hedge->legs;
+  node.client->Command(hedge->args,
+    async::Bind<void(const ZResult<RedisMessage>&)>(
+      &ReplicaRedisClient::OnLegReply, this, index,
+      std::chrono::steady_clock::now(), hedge));
+}
+
+void ReplicaRedisClient::OnLegReply(size_t index,
+  std::chrono::steady_clock::time_point start, std::shared_ptr<Hedge> hedge,
+  const ZResult<RedisMessage>& reply)
+{
+  Node& node = nodes_[index];
+  --node.outstanding;
+  --hedge->legs;
+  if (reply)
+  {
+    // the loser's latency counts too, it is the tail being cut
+    Sample(node, start);
+    RecordLatency(start);
+  }
+
+  if (hedge->done || (!reply && hedge->legs > 0))
+  {
+    // answered already, or the other leg may still succeed
+    return;
+  }
+
+  hedge->done = true;
+  if (hedge->timer_pending)
+  {
+    app_.RemoveTimer(hedge->timer);
+    hedge->timer_pending = false;
+  }
+  if (index != hedge->first)
+  {
+    ++stats_.hedge_wins;
+  }
+  hedge->callback.Invoke(reply);
+}
+
+void ReplicaRedisClient::OnHedgeTimer(
+  std::shared_ptr<Hedge> hedge, TickTimerID timer_id)
+{
+  hedge->timer_pending = false;
+  if (hedge->done ||
+      stats_.hedges + 1 > stats_.replica_reads * options_.hedge.max_ratio)
+  {
+    return;
+  }
+
+  size_t index = PickReplica(hedge->first);
+  if (index == 0 && (hedge->first == 0 || !nodes_[0].client ||
+                      !nodes_[0].connected))
+  {
+    return;
+  }
+
+  ++stats_.hedges;
+  SendLeg(index, hedge);
+}
+
+void ReplicaRedisClient::RecordLatency(
+  std::chrono::steady_clock::time_point start)
+{
+  if (!options_.hedge.enabled)
+  {
+    return;
+  }
+
+  double sample = std::chrono::duration<double, std::micro>(
+    std::chrono::steady_clock::now() - start)
+                    .count();
+  if (latencies_.size() < LATENCY_WINDOW)
+  {
+    latencies_.push_back(sample);
+  }
+  else
+  {
+    latencies_[latency_pos_] = sample;
+  }
+  latency_pos_ = (latency_pos_ + 1) % LATENCY_WINDOW;
+  if (latency_pos_ % LATENCY_REFRESH != 0)
+  {
+    return;
+  }
+
+  std::vector<double> sorted(latencies_);
+  auto nth = sorted.begin() +
+             static_cast<size_t>(
+               options_.hedge.percentile * (sorted.size() - 1));
+  std::nth_element(sorted.begin(), nth, sorted.end());
+  hedge_delay_ = std::chrono::microseconds(static_cast<int64_t>(*nth));
+}
+
+std::chrono::milliseconds ReplicaRedisClient::HedgeDelay() const
+{
+  if (hedge_delay_.count() == 0)
+  {
+    return options_.hedge.max_delay;
+  }
+  return std::min(std::chrono::ceil<std::chrono::milliseconds>(hedge_delay_),
+    options_.hedge.max_delay);
+}
+
+ReplicaRedisClientStats ReplicaRedisClient::Stats() const
+{
+  ReplicaRedisClientStats stats = stats_;
+  stats.hedge_delay = hedge_delay_;
+  for (size_t i = 1; i < nodes_.size(); ++i)
+  {
+    const Node& node = nodes_[i];
+    auto& replica = stats.replicas.emplace_back();
+    replica.server = node.server;
+    replica.connected = node.connected;
+    replica.fresh = node.fresh;
+    replica.healthy = node.client && node.client->Healthy();
+    replica.latency = std::chrono::microseconds(
+      static_cast<int64_t>(node.latency < 0 ? 0 : node.latency));
+    replica.outstanding = node.outstanding;
+    replica.reads = node.reads;
+    replica.lag_bytes = node.lag_bytes;
+    if (node.client)
+    {
+      replica.ping_rtt = node.client->Stats().ping_rtt;
+    }
+  }
+  return stats;
+}
+
+void ReplicaRedisClient::OnConnected(size_t index, int error)
+{
+  if (error)
+  {
+    OnDisconnect(index);
+    return;
+  }
+
+  // a replica is read from once a check has found it fresh
+  nodes_[index].connected = true;
+}
+
+void ReplicaRedisClient::OnDisconnect(size_t index)
+{
+  Node& node = nodes_[index];
+  node.connected = false;
+  node.fresh = false;
+  app_.AddOneshotTimer(std::chrono::seconds{1},
+    async::Bind<void(TickTimerID)>(
+      &ReplicaRedisClient::OnReconnectTimer, this, index));
+}
+
+void ReplicaRedisClient::OnReconnectTimer(size_t index, TickTimerID timer_id)
+{
+  Node& node = nodes_[index];
+  if (node.client && !node.connected)
+  {
+    node.client->Connect(node.server);
+  }
+}
+
+void ReplicaRedisClient::OnCheckTimer(TickTimerID timer_id)
+{
+  for (size_t i = 0; i < nodes_.size(); ++i)
+  {
+    Node& node = nodes_[i];
+    if (!node.client || !node.connected)
+    {
+      continue;
+    }
+
+    if (options_.health_check)
+    {
+      auto client_stats = node.client->Stats();
+      if (client_stats.pongs != node.pongs)
+      {
+        node.pongs = client_stats.pongs;
+        Sample(node, static_cast<double>(client_stats.ping_rtt.count()));
+      }
+    }
+
+    // doubles as a latency probe for replicas not being read from
+    auto now = std::chrono::steady_clock::now();
+    node.client->Command(std::vector<RedisArg>{"INFO", "replication"},
+      async::Bind<void(const ZResult<RedisMessage>&)>(
+        &ReplicaRedisClient::OnInfo, this, i, now));
+  }
+}
+
+void ReplicaRedisClient::OnInfo(size_t index,
+  std::chrono::steady_clock::time_point start,
+  const ZResult<RedisMessage>& reply)
+{
+  Node& node = nodes_[index];
+  const RedisString* bulk = reply ? std::get_if<1>(&reply.Value()) : nullptr;
+  const std::string* info = bulk ? std::get_if<1>(bulk) : nullptr;
+  if (info == nullptr)
+  {
+    node.fresh = false;
+    return;
+  }
+
+  if (index == 0)
+  {
+    node.offset = InfoInteger(*info, "master_repl_offset");
+    return;
+  }
+
+  Sample(node, start);
+  node.offset = InfoInteger(*info, "slave_repl_offset");
+  const Node& primary = nodes_[0];
+  node.lag_bytes = node.offset >= 0 && primary.offset >= 0
+                     ? std::max<int64_t>(primary.offset - node.offset, 0)
+                     : 0;
+
+  int64_t idle = InfoInteger(*info, "master_last_io_seconds_ago");
+  uint64_t lag = static_cast<uint64_t>(node.lag_bytes);
+  node.fresh = InfoField(*info, "master_link_status") == "up" && idle >= 0 &&
+               idle <= options_.max_staleness.count() &&
+               (options_.max_lag_bytes == 0 || lag <= options_.max_lag_bytes);
+}
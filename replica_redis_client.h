@@ -0,0 +1,167 @@
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <string_view>
+#include <vector>
+#include "app.h"
+#include "callback.h"
+#include "redis_client.h"
+#include "thirtyparty/asio/asio.hpp"
+
+enum class ReplicaSelection
+{
+  // lowest moving average of recent read latency
+  kLowestLatency,
+  kFewestOutstanding,
+};
+
+// Opt-in hedging of reads: a read still unanswered after the given
+// percentile of recent read latency is sent again to another replica (or
+// the primary) and the first reply wins.
+struct HedgeOptions
+{
+  bool enabled = false;
+  double percentile = 0.95;
+  // delay used until enough latency samples exist, and its upper bound
+  std::chrono::milliseconds max_delay{100};
+  // hedged reads as a fraction of all replica reads, at most
+  double max_ratio = 0.05;
+};
+
+struct ReplicaRoutingOptions
+{
+  ReplicaSelection selection = ReplicaSelection::kLowestLatency;
+  // weight of the newest sample in the latency average
+  double latency_alpha = 0.2;
+  // A replica is read from only while its link to the primary is up, has
+  // heard from the primary within max_staleness and, unless max_lag_bytes
+  // is 0, is within max_lag_bytes of the primary's replication offset.
+  std::chrono::seconds max_staleness{10};
+  uint64_t max_lag_bytes = 0;
+  // how often INFO replication is polled
+  std::chrono::seconds check_interval{1};
+  HedgeOptions hedge;
+  PipelineOptions pipeline;
+  // PING every node; unhealthy replicas are not read from, and ping round
+  // trips feed the latency average
+  bool health_check = false;
+  HealthCheckOptions health;
+};
+
+struct ReplicaStats
+{
+  asio::ip::tcp::endpoint server;
+  bool connected = false;
+  // passed the last staleness check
+  bool fresh = false;
+  bool healthy = false;
+  std::chrono::microseconds latency{0};
+  std::chrono::microseconds ping_rtt{0};
+  size_t outstanding = 0;
+  uint64_t reads = 0;
+  int64_t lag_bytes = 0;
+};
+
+struct ReplicaRedisClientStats
+{
+  uint64_t writes = 0;
+  uint64_t replica_reads = 0;
+  // reads sent to the primary because no replica was usable
+  uint64_t fallback_reads = 0;
+  // duplicates sent by hedging, and how many of them answered first
+  uint64_t hedges = 0;
+  uint64_t hedge_wins = 0;
+  std::chrono::microseconds hedge_delay{0};
+  std::vector<ReplicaStats> replicas;
+};
+
+// Client over a primary and its replicas. Commands the command table marks
+// read-only, and that cannot block, go to a usable replica, picked by
+// latency or outstanding requests; everything else, and reads while no
+// replica is usable, goes to the primary. Replica staleness is polled with
+// INFO replication on an App timer. Hedge delays are rounded up to App's
+// tick, so hedging wants an App built with a fine tick.
+class ReplicaRedisClient : public async::CallbackHost
+{
+public:
+  ReplicaRedisClient(
+    App& app, const ReplicaRoutingOptions& options = ReplicaRoutingOptions{});
+  ~ReplicaRedisClient();
+
+  void SetPrimary(const asio::ip::tcp::endpoint& server);
+  void AddReplica(const asio::ip::tcp::endpoint& server);
+
+  void Command(
+    const std::vector<RedisArg>& args, const CommandCallback& cb_cmd);
+  // Always on the primary, e.g. to read the client's own writes.
+  void CommandPrimary(
+    const std::vector<RedisArg>& args, const CommandCallback& cb_cmd);
+
+  ReplicaRedisClientStats Stats() const;
+
+private:
+  struct Node
+  {
+    asio::ip::tcp::endpoint server;
+    std::unique_ptr<RedisClient> client;
+    bool connected = false;
+    bool fresh = false;
+    // latency average in microseconds, negative until the first sample
+    double latency = -1;
+    size_t outstanding = 0;
+    uint64_t reads = 0;
+    int64_t offset = 0;
+    int64_t lag_bytes = 0;
+    // answered health check pings already sampled
+    uint64_t pongs = 0;
+  };
+
+  // a read that may be sent to more than one node
+  struct Hedge
+  {
+    std::vector<RedisArg> args;
+    CommandCallback callback;
+    size_t first = 0;
+    // legs sent and not yet answered
+    size_t legs = 0;
+    bool done = false;
+    bool timer_pending = false;
+    TickTimerID timer{nullptr};
+  };
+
+  // node index 0 is the primary
+  void Connect(size_t index);
+  size_t PickReplica(size_t exclude = 0) const;
+  void OnRead(size_t index, std::chrono::steady_clock::time_point start,
+    CommandCallback cb_cmd, const ZResult<RedisMessage>& reply);
+  void Sample(Node& node, std::chrono::steady_clock::time_point start);
+  void Sample(Node& node, double micros);
+
+  void HedgedRead(size_t index, const std::vector<RedisArg>& args,
+    const CommandCallback& cb_cmd);
+  void SendLeg(size_t index, const std::shared_ptr<Hedge>& hedge);
+  void OnLegReply(size_t index, std::chrono::steady_clock::time_point start,
+    std::shared_ptr<Hedge> hedge, const ZResult<RedisMessage>& reply);
+  void OnHedgeTimer(std::shared_ptr<Hedge> hedge, TickTimerID timer_id);
+  void RecordLatency(std::chrono::steady_clock::time_point start);
+  std::chrono::milliseconds HedgeDelay() const;
+
+  void OnConnected(size_t index, int error);
+  void OnDisconnect(size_t index);
+  void OnReconnectTimer(size_t index, TickTimerID timer_id);
+  void OnCheckTimer(TickTimerID timer_id);
+  void OnInfo(size_t index, std::chrono::steady_clock::time_point start,
+    const ZResult<RedisMessage>& reply);
+
+private:
+  App& app_;
+  ReplicaRoutingOptions options_;
+  std::vector<Node> nodes_;
+  TickTimerID check_timer_;
+  // recent read latencies in microseconds, for the hedge delay
+  std::vector<double> latencies_;
+  size_t latency_pos_;
+  std::chrono::microseconds hedge_delay_;
+  ReplicaRedisClientStats stats_;
+};
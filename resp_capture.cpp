@@ -0,0 +1,96 @@
+#include "resp_capture.h"
+#include <chrono>
+#include <cstring>
+
+#define CAPTURE_MAGIC "RESPCAP1"
+#define CAPTURE_MAGIC_SIZE 8
+#define RECORD_HEADER_SIZE (sizeof(uint64_t) + sizeof(uint32_t))
+
+///////////////////////////////////////////////////////////////////////////////
+// RESPCaptureWriter
+RESPCaptureWriter::~RESPCaptureWriter()
+{
+  Close();
+}
+
+bool RESPCaptureWriter::Open(const std::string& path)
+{
+  Close();
+
+  file_ = std::fopen(path.c_str(), "wb");
+  if (file_ == nullptr)
+  {
+    return false;
+  }
+
+  std::setvbuf(file_, nullptr, _IOFBF, 1024 * 1024);
+  std::fwrite(CAPTURE_MAGIC, 1, CAPTURE_MAGIC_SIZE, file_);
+  return true;
+}
+
+void RESPCaptureWriter::Append(std::string_view bytes)
+{
+  if (file_ == nullptr)
+  {
+    return;
+  }
+
+  uint64_t timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::system_clock::now().time_since_epoch())
+                         .count();
+  uint32_t len = static_cast<uint32_t>(bytes.size());
+  std::fwrite(&timestamp, sizeof(timestamp), 1, file_);
+  std::fwrite(&len, sizeof(len), 1, file_);
+  std::fwrite(bytes.data(), 1, bytes.size(), file_);
+}
+
+void RESPCaptureWriter::Close()
+{
+  if (file_)
+  {
+    std::fclose(file_);
+    file_ = nullptr;
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// RESPCaptureReader
+bool RESPCaptureReader::Open(const std::string& path)
+{
+  if (!file_.OpenReadOnly(path) || file_.Size() < CAPTURE_MAGIC_SIZE ||
+      std::memcmp(file_.Data(), CAPTURE_MAGIC, CAPTURE_MAGIC_SIZE) != 0)
+  {
+    file_.Close();
+    return false;
+  }
+
+  Rewind();
+  return true;
+}
+
+bool RESPCaptureReader::Next(Record& record)
+{
+  const char* data = file_.Data();
+  size_t size = file_.Size();
+  if (pos_ + RECORD_HEADER_SIZE > size)
+  {
+    return false;
+  }
+
+  uint32_t len;
+  std::memcpy(&record.timestamp, data + pos_, sizeof(uint64_t));
+  std::memcpy(&len, data + pos_ + sizeof(uint64_t), sizeof(uint32_t));
+  if (pos_ + RECORD_HEADER_SIZE + len > size)
+  {
+    return false;
+  }
+
+  record.data = std::string_view(data + pos_ + RECORD_HEADER_SIZE, len);
+  pos_ += RECORD_HEADER_SIZE + len;
+  return true;
+}
+
+void RESPCaptureReader::Rewind()
+{
+  pos_ = CAPTURE_MAGIC_SIZE;
+}
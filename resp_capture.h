@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include "mapped_file.h"
+
+// Capture file layout: the magic "RESPCAP1", then one record per socket
+// read: [uint64 timestamp, ns since epoch][uint32 length][bytes], in host
+// byte order.
+class RESPCaptureWriter
+{
+public:
+  RESPCaptureWriter() = default;
+  ~RESPCaptureWriter();
+
+  RESPCaptureWriter(const RESPCaptureWriter&) = delete;
+  RESPCaptureWriter& operator=(const RESPCaptureWriter&) = delete;
+
+  bool Open(const std::string& path);
+  void Append(std::string_view bytes);
+  void Close();
+
+private:
+  std::FILE* file_ = nullptr;
+};
+
+// Walks the records of a capture file mapped into memory.
+class RESPCaptureReader
+{
+public:
+  struct Record
+  {
+    uint64_t timestamp;
+    std::string_view data;
+  };
+
+  bool Open(const std::string& path);
+  // Returns false at the end of the file or at a truncated record.
+  bool Next(Record& record);
+  void Rewind();
+
+private:
+  MappedFile file_;
+  size_t pos_ = 0;
+};
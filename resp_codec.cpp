@@ -1,5 +1,7 @@
 #include "resp_codec.h"
+#include <algorithm>
 #include <charconv>
+#include <cstring>
 #include <sstream>
 
 // https://redis.io/topics/protocol
@@ -12,9 +14,284 @@
 
 ///////////////////////////////////////////////////////////////////////////////
 // RESPEncoder
+#define CRLF_SIZE 2
+
+static size_t DigitCount(int64_t value)
+{
+  uint64_t v = value < 0 ? 0 - static_cast<uint64_t>(value) : value;
+  size_t count = value < 0 ? 2 : 1;
+  while (v >= 10)
+  {
+    v /= 10;
+    ++count;
+  }
+
+  return count;
+}
+
+// size of "<prefix><value>\r\n"
+static size_t HeaderSize(int64_t value)
+{
+  return 1 + DigitCount(value) + CRLF_SIZE;
+}
+
+static size_t BulkSize(size_t len, size_t gather_threshold)
+{
+  size_t size = HeaderSize(len) + CRLF_SIZE;
+  return len < gather_threshold ? size + len : size;
+}
+
+static size_t BulkSize(const RedisString& rs, size_t gather_threshold)
+{
+  if (rs.index() == 0)
+  {
+    return HeaderSize(-1);
+  }
+
+  return BulkSize(std::get<1>(rs).size(), gather_threshold);
+}
+
+// Bytes of msg that end up in the contiguous buffer; payloads at least
+// gather_threshold long are left out since they are referenced in place.
+static size_t ContiguousSize(const RedisMessage& msg, size_t gather_threshold)
+{
+  switch (msg.index())
+  {
+    case 0:  // integer
+      return HeaderSize(std::get<0>(msg));
+    case 1:  // string
+      return BulkSize(std::get<1>(msg), gather_threshold);
+    case 2:  // error
+      return 1 + std::get<2>(msg).size() + CRLF_SIZE;
+    case 3:  // array
+    {
+      const RedisArray& ra = std::get<3>(msg);
+      if (ra.array.index() == 0)
+      {
+        return HeaderSize(-1);
+      }
+
+      const auto& elements = std::get<1>(ra.array);
+      size_t size = HeaderSize(elements.size());
+      for (const auto& element : elements)
+      {
+        size += ContiguousSize(element, gather_threshold);
+      }
+      return size;
+    }
+    default:
+      return 0;
+  }
+}
+
+namespace
+{
+class RESPWriter
+{
+public:
+  RESPWriter(char* buf, size_t gather_threshold,
+    std::vector<std::string_view>* iov)
+    : pos_(buf)
+    , mark_(buf)
+    , gather_threshold_(gather_threshold)
+    , iov_(iov)
+  {
+  }
+
+  void Write(const RedisMessage& msg)
+  {
+    switch (msg.index())
+    {
+      case 0:  // integer
+        WriteHeader(INTEGER_PREFIX, std::get<0>(msg));
+        break;
+      case 1:  // string
+        WriteBulk(std::get<1>(msg));
+        break;
+      case 2:  // error
+        WriteLine(ERROR_PREFIX, std::get<2>(msg));
+        break;
+      case 3:  // array
+      {
+        const RedisArray& ra = std::get<3>(msg);
+        if (ra.array.index() == 0)
+        {
+          WriteHeader(ARRAY_PREFIX, -1);
+          break;
+        }
+
+        const auto& elements = std::get<1>(ra.array);
+        WriteHeader(ARRAY_PREFIX, elements.size());
+        for (const auto& element : elements)
+        {
+          Write(element);
+        }
+      }
+      break;
+    }
+  }
+
+  void Write(const RedisRequest& cmd)
+  {
+    WriteHeader(ARRAY_PREFIX, cmd.size());
+    for (const auto& arg : cmd)
+    {
+      WriteBulk(arg);
+    }
+  }
+
+  void Write(const std::vector<std::string_view>& args)
+  {
+    WriteHeader(ARRAY_PREFIX, args.size());
+    for (const auto& arg : args)
+    {
+      WriteBulk(arg);
+    }
+  }
+
+  // Push the pending contiguous bytes as the last iov entry.
+  char* Finish()
+  {
+    Flush();
+    return pos_;
+  }
+
+private:
+  void WriteHeader(char prefix, int64_t value)
+  {
+    *pos_++ = prefix;
+    pos_ = std::to_chars(pos_, pos_ + 20, value).ptr;
+    WriteCRLF();
+  }
+
+  void WriteLine(char prefix, std::string_view line)
+  {
+    *pos_++ = prefix;
+    WriteRaw(line);
+    WriteCRLF();
+  }
+
+  void WriteBulk(const RedisString& rs)
+  {
+    if (rs.index() == 0)
+    {
+      WriteHeader(BULK_STR_PREFIX, -1);
+      return;
+    }
+
+    WriteBulk(std::string_view(std::get<1>(rs)));
+  }
+
+  void WriteBulk(std::string_view payload)
+  {
+    WriteHeader(BULK_STR_PREFIX, payload.size());
+    if (payload.size() < gather_threshold_)
+    {
+      WriteRaw(payload);
+    }
+    else
+    {
+      // reference the payload in place
+      Flush();
+      iov_->emplace_back(payload);
+    }
+    WriteCRLF();
+  }
+
+  void WriteRaw(std::string_view sv)
+  {
+    std::memcpy(pos_, sv.data(), sv.size());
+    pos_ += sv.size();
+  }
+
+  void WriteCRLF()
+  {
+    *pos_++ = '\r';
+    *pos_++ = '\n';
+  }
+
+  void Flush()
+  {
+    if (iov_ && pos_ != mark_)
+    {
+      iov_->emplace_back(mark_, pos_ - mark_);
+    }
+    mark_ = pos_;
+  }
+
+private:
+  char* pos_;
+  char* mark_;
+  size_t gather_threshold_;
+  std::vector<std::string_view>* iov_;
+};
+}  // namespace
+
 std::string RESPEncoder::Encode(const RedisMessage& msg)
 {
-  return ToString(msg);
+  std::string out(EncodedSize(msg), '\0');
+  RESPWriter writer(out.data(), SIZE_MAX, nullptr);
+  writer.Write(msg);
+  return out;
+}
+
+std::string RESPEncoder::Encode(const RedisRequest& cmd)
+{
+  std::string out(EncodedSize(cmd), '\0');
+  RESPWriter writer(out.data(), SIZE_MAX, nullptr);
+  writer.Write(cmd);
+  return out;
+}
+
+size_t RESPEncoder::Encode(const RedisMessage& msg, char* buf, size_t len)
+{
+  if (len < EncodedSize(msg))
+  {
+    return 0;
+  }
+
+  RESPWriter writer(buf, SIZE_MAX, nullptr);
+  writer.Write(msg);
+  return writer.Finish() - buf;
+}
+
+void RESPEncoder::Encode(const RedisMessage& msg, std::string& scratch,
+  std::vector<std::string_view>& iov)
+{
+  scratch.resize(ContiguousSize(msg, kGatherThreshold));
+  RESPWriter writer(scratch.data(), kGatherThreshold, &iov);
+  writer.Write(msg);
+  writer.Finish();
+}
+
+void RESPEncoder::Encode(const std::vector<std::string_view>& args,
+  std::string& scratch, std::vector<std::string_view>& iov)
+{
+  size_t size = HeaderSize(args.size());
+  for (const auto& arg : args)
+  {
+    size += BulkSize(arg.size(), kGatherThreshold);
+  }
+
+  scratch.resize(size);
+  RESPWriter writer(scratch.data(), kGatherThreshold, &iov);
+  writer.Write(args);
+  writer.Finish();
+}
+
+size_t RESPEncoder::EncodedSize(const RedisMessage& msg)
+{
+  return ContiguousSize(msg, SIZE_MAX);
+}
+
+size_t RESPEncoder::EncodedSize(const RedisRequest& cmd)
+{
+  size_t size = HeaderSize(cmd.size());
+  for (const auto& arg : cmd)
+  {
+    size += BulkSize(arg, SIZE_MAX);
+  }
+  return size;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -93,6 +370,7 @@ RedisString RESPDecoder::DecodeBulkStr(std::string_view& sv)
   if (len == -1)
   {
     // null string
+    sv.remove_prefix(pos + 2);
     return {nullptr};
   }
 
@@ -110,6 +388,7 @@ RedisArray RESPDecoder::DecodeArray(std::string_view& sv)
   if (len == -1)
   {
     // null array
+    sv.remove_prefix(pos + 2);
     return {nullptr};
   }
 
@@ -125,6 +404,182 @@ RedisArray RESPDecoder::DecodeArray(std::string_view& sv)
   return ret;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// RESPParser
+ZResult<RedisMessage> RESPParser::Parse(std::string_view& sv)
+{
+  return Parse(sv, 0);
+}
+
+ZResult<RedisMessage> RESPParser::Parse(std::string_view& sv, int depth)
+{
+  if (sv.empty())
+  {
+    return Failure(RCE_LESSDATA);
+  }
+
+  switch (sv[0])
+  {
+    case SIMPLE_STR_PREFIX:
+    {
+      return DecodeSimpleStr(sv);
+    }
+    break;
+    case ERROR_PREFIX:
+    {
+      return DecodeError(sv);
+    }
+    break;
+    case INTEGER_PREFIX:
+    {
+      return DecodeInteger(sv);
+    }
+    break;
+    case BULK_STR_PREFIX:
+    {
+      return DecodeBulkStr(sv);
+    }
+    break;
+    case ARRAY_PREFIX:
+    {
+      return DecodeArray(sv, depth);
+    }
+    break;
+    default:
+      break;
+  }
+
+  return Failure(RCE_PROTOCOL);
+}
+
+ZResult<RedisString> RESPParser::DecodeSimpleStr(std::string_view& sv)
+{
+  auto pos = sv.find("\r\n");
+  if (pos == std::string_view::npos)
+  {
+    return Failure(RCE_LESSDATA);
+  }
+
+  RedisString ret = std::string{sv.substr(1, pos - 1)};
+  sv.remove_prefix(pos + 2);
+  return Success(std::move(ret));
+}
+
+ZResult<RedisError> RESPParser::DecodeError(std::string_view& sv)
+{
+  auto pos = sv.find("\r\n");
+  if (pos == std::string_view::npos)
+  {
+    return Failure(RCE_LESSDATA);
+  }
+
+  RedisError ret{sv.substr(1, pos - 1)};
+  sv.remove_prefix(pos + 2);
+  return Success(std::move(ret));
+}
+
+ZResult<int64_t> RESPParser::DecodeInteger(std::string_view& sv)
+{
+  auto pos = sv.find("\r\n");
+  if (pos == std::string_view::npos)
+  {
+    return Failure(RCE_LESSDATA);
+  }
+
+  int64_t ret;
+  auto [ptr, ec] = std::from_chars(sv.data() + 1, sv.data() + pos, ret);
+  if (ec != std::errc{})
+  {
+    return Failure(RCE_PROTOCOL);
+  }
+
+  sv.remove_prefix(pos + 2);
+  return Success(ret);
+}
+
+ZResult<RedisString> RESPParser::DecodeBulkStr(std::string_view& sv)
+{
+  std::string_view sv_copy(sv);
+  auto pos = sv_copy.find("\r\n");
+  if (pos == std::string_view::npos)
+  {
+    return Failure(RCE_LESSDATA);
+  }
+
+  int len = 0;
+  auto [ptr, ec] =
+    std::from_chars(sv_copy.data() + 1, sv_copy.data() + pos, len);
+  if (ec != std::errc{} || len < -1)
+  {
+    return Failure(RCE_PROTOCOL);
+  }
+
+  if (len == -1)
+  {
+    // null string
+    sv.remove_prefix(pos + 2);
+    return Success(RedisString(nullptr));
+  }
+
+  if (sv_copy.size() < pos + 2 + len + 2)
+  {
+    return Failure(RCE_LESSDATA);
+  }
+
+  sv.remove_prefix(pos + 2 + len + 2);
+  return Success(RedisString(std::string(sv_copy.data() + pos + 2, len)));
+}
+
+ZResult<RedisArray> RESPParser::DecodeArray(std::string_view& sv, int depth)
+{
+  if (depth >= kMaxDepth)
+  {
+    return Failure(RCE_PROTOCOL);
+  }
+
+  std::string_view sv_copy(sv);
+  auto pos = sv_copy.find("\r\n");
+  if (pos == std::string_view::npos)
+  {
+    return Failure(RCE_LESSDATA);
+  }
+
+  int len = 0;
+  auto [ptr, ec] =
+    std::from_chars(sv_copy.data() + 1, sv_copy.data() + pos, len);
+  if (ec != std::errc{} || len < -1)
+  {
+    return Failure(RCE_PROTOCOL);
+  }
+
+  if (len == -1)
+  {
+    // null array
+    sv.remove_prefix(pos + 2);
+    return Success(RedisArray{nullptr});
+  }
+
+  sv.remove_prefix(pos + 2);
+
+  // len comes from the wire: reserve no more than the elements the buffer
+  // can still hold (at least 3 bytes each) and grow from there
+  RedisArray ret{RedisArray::Elements()};
+  auto& elements = std::get<1>(ret.array);
+  elements.reserve(std::min<size_t>(len, sv.size() / 3));
+  for (int i = 0; i < len; ++i)
+  {
+    ZResult<RedisArray::Element> result = Parse(sv, depth + 1);
+    if (!result)
+    {
+      return Failure(result.Error());
+    }
+
+    elements.push_back(result.Value());
+  }
+
+  return Success(std::move(ret));
+}
+
 static void InternalToString(const RedisMessage& msg, std::ostringstream& oss)
 {
   switch (msg.index())
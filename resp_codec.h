@@ -1,9 +1,15 @@
 #pragma once
 
 #include <cstdint>
+#include <string>
 #include <string_view>
 #include <variant>
 #include <vector>
+#include "result.h"
+
+#define RCE_SUCCESS 0
+#define RCE_LESSDATA 1
+#define RCE_PROTOCOL 2
 
 using RedisInteger = int64_t;
 using RedisString = std::variant<nullptr_t, std::string>;
@@ -26,8 +32,29 @@ using RedisResponse = RedisMessage;
 class RESPEncoder
 {
 public:
+  // Bulk payloads at least this long are referenced in place by the gather
+  // form of Encode instead of being copied into the scratch buffer.
+  static constexpr size_t kGatherThreshold = 1024;
+
   std::string Encode(const RedisMessage& msg);
   std::string Encode(const RedisRequest& cmd);
+
+  // Encode into a caller-provided buffer. Returns the number of bytes
+  // written, or 0 if len is smaller than EncodedSize(msg).
+  size_t Encode(const RedisMessage& msg, char* buf, size_t len);
+
+  // Gather form: headers and short payloads are written into scratch (which
+  // is overwritten and allocated once), long bulk payloads are referenced
+  // directly from msg. Views are appended to iov and stay valid as long as
+  // both msg and scratch are left untouched.
+  void Encode(const RedisMessage& msg, std::string& scratch,
+    std::vector<std::string_view>& iov);
+  // Gather form of a command given as raw arguments.
+  void Encode(const std::vector<std::string_view>& args, std::string& scratch,
+    std::vector<std::string_view>& iov);
+
+  static size_t EncodedSize(const RedisMessage& msg);
+  static size_t EncodedSize(const RedisRequest& cmd);
 };
 
 class RESPDecoder
@@ -44,4 +71,24 @@ private:
   RedisMessage InternalDecode(std::string_view& sv);
 };
 
+// Incremental reply parser. Parse consumes one complete message from the
+// front of sv; on RCE_LESSDATA the input ends inside a message and more
+// data is needed, and sv must be considered partially consumed, so callers
+// parse from a copy. Arrays nested deeper than kMaxDepth are RCE_PROTOCOL.
+class RESPParser
+{
+public:
+  static constexpr int kMaxDepth = 64;
+
+  ZResult<RedisMessage> Parse(std::string_view& sv);
+
+private:
+  ZResult<RedisMessage> Parse(std::string_view& sv, int depth);
+  ZResult<RedisString> DecodeSimpleStr(std::string_view& sv);
+  ZResult<RedisError> DecodeError(std::string_view& sv);
+  ZResult<int64_t> DecodeInteger(std::string_view& sv);
+  ZResult<RedisString> DecodeBulkStr(std::string_view& sv);
+  ZResult<RedisArray> DecodeArray(std::string_view& sv, int depth);
+};
+
 std::string ToString(const RedisMessage& msg);
@@ -0,0 +1,206 @@
+#include "resp_connection.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+#define RBUF_INITSIZE (16 * 1024)
+
+RESPConnection::RESPConnection(asio::ip::tcp::socket socket,
+  size_t max_pending_replies, size_t max_request_size)
+  : socket_(std::move(socket))
+  , max_pending_replies_(max_pending_replies)
+  , max_request_size_(std::max<size_t>(max_request_size, 1))
+  , rbuffer_(std::min<size_t>(RBUF_INITSIZE, max_request_size_))
+  , rpos_(0)
+  , reading_(false)
+  , writing_(false)
+  , flush_scheduled_(false)
+  , closing_(false)
+{
+}
+
+void RESPConnection::Close()
+{
+  closing_ = true;
+  std::error_code ec;
+  socket_.close(ec);
+}
+
+std::string RESPConnection::CommandName(const RedisMessage& request)
+{
+  const RedisArray* array = std::get_if<3>(&request);
+  const RedisArray::Elements* args =
+    array ? std::get_if<1>(&array->array) : nullptr;
+  const RedisString* first =
+    args && !args->empty() ? std::get_if<1>(&args->front()) : nullptr;
+  const std::string* name = first ? std::get_if<1>(first) : nullptr;
+  if (name == nullptr)
+  {
+    return {};
+  }
+
+  std::string upper(*name);
+  std::transform(upper.begin(), upper.end(), upper.begin(),
+    [](unsigned char c) { return static_cast<char>(std::toupper(c)); });
+  return upper;
+}
+
+void RESPConnection::Fill(ReplySlot* slot, std::string_view reply)
+{
+  if (slot->ready)
+  {
+    return;
+  }
+
+  slot->reply.assign(reply.data(), reply.size());
+  slot->ready = true;
+  ScheduleFlush();
+}
+
+void RESPConnection::Reply(std::string_view reply)
+{
+  auto& slot = slots_.emplace_back();
+  slot.reply.assign(reply.data(), reply.size());
+  slot.ready = true;
+}
+
+void RESPConnection::Reply(const RedisMessage& reply)
+{
+  auto& slot = slots_.emplace_back();
+  slot.reply = RESPEncoder().Encode(reply);
+  slot.ready = true;
+}
+
+void RESPConnection::Read()
+{
+  if (reading_ || closing_ || slots_.size() >= max_pending_replies_)
+  {
+    return;
+  }
+
+  if (rpos_ == rbuffer_.size())
+  {
+    // a request larger than the buffer
+    if (rbuffer_.size() >= max_request_size_)
+    {
+      ProtocolError();
+      return;
+    }
+    rbuffer_.resize(std::min(rbuffer_.size() * 2, max_request_size_));
+  }
+
+  reading_ = true;
+  auto self = shared_from_this();
+  socket_.async_read_some(
+    asio::buffer(rbuffer_.data() + rpos_, rbuffer_.size() - rpos_),
+    [self](const std::error_code& ec, std::size_t len) {
+      self->reading_ = false;
+      if (ec)
+      {
+        self->Close();
+        return;
+      }
+
+      self->OnRead(len);
+      self->Read();
+    });
+}
+
+void RESPConnection::OnRead(size_t len)
+{
+  rpos_ += len;
+
+  std::string_view sv(rbuffer_.data(), rpos_);
+  while (!sv.empty() && !closing_)
+  {
+    std::string_view rest(sv);
+    auto ret = parser_.Parse(rest);
+    if (!ret)
+    {
+      if (ret.Error() != RCE_LESSDATA)
+      {
+        ProtocolError();
+        return;
+      }
+      break;
+    }
+
+    std::string_view raw = sv.substr(0, sv.size() - rest.size());
+    sv = rest;
+    HandleRequest(ret.Value(), raw);
+  }
+
+  // keep the incomplete tail for the next read
+  if (!sv.empty() && sv.data() != rbuffer_.data())
+  {
+    std::memmove(rbuffer_.data(), sv.data(), sv.size());
+  }
+  rpos_ = sv.size();
+
+  // replies produced inline go out with this read cycle
+  ScheduleFlush();
+}
+
+void RESPConnection::ProtocolError()
+{
+  // after the replies to the requests before it, as Redis does
+  Reply("-ERR Protocol error\r\n");
+  CloseAfterReplies();
+  ScheduleFlush();
+}
+
+void RESPConnection::ScheduleFlush()
+{
+  if (flush_scheduled_)
+  {
+    return;
+  }
+
+  flush_scheduled_ = true;
+  auto self = shared_from_this();
+  asio::post(socket_.get_executor(), [self] {
+    self->flush_scheduled_ = false;
+    self->Flush();
+  });
+}
+
+void RESPConnection::Flush()
+{
+  while (!slots_.empty() && slots_.front().ready)
+  {
+    pending_ += slots_.front().reply;
+    slots_.pop_front();
+  }
+
+  if (writing_ || !socket_.is_open())
+  {
+    return;
+  }
+
+  if (pending_.empty())
+  {
+    if (closing_ && slots_.empty())
+    {
+      Close();
+    }
+    return;
+  }
+
+  wbuffer_.swap(pending_);
+  pending_.clear();
+  writing_ = true;
+  auto self = shared_from_this();
+  asio::async_write(socket_, asio::buffer(wbuffer_),
+    [self](const std::error_code& ec, std::size_t) {
+      self->writing_ = false;
+      if (ec)
+      {
+        self->Close();
+        return;
+      }
+
+      self->Flush();
+      // room for more outstanding replies again
+      self->Read();
+    });
+}
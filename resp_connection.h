@@ -0,0 +1,73 @@
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "resp_codec.h"
+#include "thirtyparty/asio/asio.hpp"
+
+// Server side of a RESP connection. Pipelined requests are parsed as they
+// arrive and handed to HandleRequest; replies are queued in request order
+// and the ready ones are written back in one write per batch, i.e. per read
+// cycle for replies produced inline, per wake-up for deferred ones. A
+// request that does not parse, or does not fit in max_request_size bytes,
+// is answered with a protocol error and the connection is closed.
+class RESPConnection : public std::enable_shared_from_this<RESPConnection>
+{
+public:
+  struct ReplySlot
+  {
+    std::string reply;
+    bool ready = false;
+  };
+
+  // as Redis' proto-max-bulk-len
+  static constexpr size_t kDefaultMaxRequestSize = 512 * 1024 * 1024;
+
+  RESPConnection(asio::ip::tcp::socket socket, size_t max_pending_replies,
+    size_t max_request_size = kDefaultMaxRequestSize);
+  virtual ~RESPConnection() = default;
+
+  void Start() { Read(); }
+  void Close();
+
+  // Upper-cased name of a request, empty if it is not an array of bulk
+  // strings.
+  static std::string CommandName(const RedisMessage& request);
+
+protected:
+  virtual void HandleRequest(
+    const RedisMessage& request, std::string_view raw) = 0;
+
+  // Reserve the next reply, to be filled in later with Fill.
+  ReplySlot* Reserve() { return &slots_.emplace_back(); }
+  void Fill(ReplySlot* slot, std::string_view reply);
+  void Reply(std::string_view reply);
+  void Reply(const RedisMessage& reply);
+  // Stop reading; close once every queued reply has been written.
+  void CloseAfterReplies() { closing_ = true; }
+
+private:
+  void Read();
+  void OnRead(size_t len);
+  void ProtocolError();
+  void ScheduleFlush();
+  void Flush();
+
+private:
+  asio::ip::tcp::socket socket_;
+  size_t max_pending_replies_;
+  size_t max_request_size_;
+  std::vector<char> rbuffer_;
+  size_t rpos_;
+  RESPParser parser_;
+  std::deque<ReplySlot> slots_;
+  std::string wbuffer_;
+  std::string pending_;
+  bool reading_;
+  bool writing_;
+  bool flush_scheduled_;
+  bool closing_;
+};
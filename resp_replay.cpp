@@ -0,0 +1,168 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include "resp_capture.h"
+#include "resp_codec.h"
+
+// Feeds a reply stream captured by RedisClient::EnableCapture through
+// RESPParser at full speed, the way RedisClient::Session does: append a read
+// to the buffer, parse every complete reply, keep the tail.
+//
+// usage: resp_replay <capture> [--chunk 0] [--iterations 1]
+//   --chunk 0 replays the reads as captured, otherwise the stream is
+//   re-split into reads of this many bytes.
+
+struct ReplayResult
+{
+  uint64_t bytes = 0;
+  uint64_t messages = 0;
+  bool ok = true;
+};
+
+// Parse every complete message in buffer and drop it.
+static bool ParseBuffer(RESPParser& parser, std::string& buffer,
+  ReplayResult& result)
+{
+  std::string_view sv(buffer);
+  while (!sv.empty())
+  {
+    std::string_view rest(sv);
+    auto ret = parser.Parse(rest);
+    if (!ret)
+    {
+      if (ret.Error() != RCE_LESSDATA)
+      {
+        return false;
+      }
+      break;
+    }
+
+    sv = rest;
+    ++result.messages;
+  }
+
+  buffer.erase(0, buffer.size() - sv.size());
+  return true;
+}
+
+static void Replay(RESPCaptureReader& reader, size_t chunk,
+  ReplayResult& result)
+{
+  RESPParser parser;
+  std::string buffer;
+  buffer.reserve(64 * 1024);
+
+  RESPCaptureReader::Record record{0, {}};
+  std::string_view pending;
+  reader.Rewind();
+  while (true)
+  {
+    if (chunk == 0)
+    {
+      if (!reader.Next(record))
+      {
+        break;
+      }
+      buffer.append(record.data);
+      result.bytes += record.data.size();
+    }
+    else
+    {
+      // gather one simulated read of up to chunk bytes
+      size_t filled = 0;
+      while (filled < chunk)
+      {
+        if (pending.empty())
+        {
+          if (!reader.Next(record))
+          {
+            break;
+          }
+          pending = record.data;
+          continue;
+        }
+
+        size_t n = std::min(chunk - filled, pending.size());
+        buffer.append(pending.data(), n);
+        pending.remove_prefix(n);
+        filled += n;
+      }
+
+      if (filled == 0)
+      {
+        break;
+      }
+      result.bytes += filled;
+    }
+
+    if (!ParseBuffer(parser, buffer, result))
+    {
+      result.ok = false;
+      return;
+    }
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc < 2 || (argc % 2) != 0)
+  {
+    std::cout << "usage: resp_replay <capture> [--chunk 0] [--iterations 1]"
+              << std::endl;
+    return 1;
+  }
+
+  size_t chunk = 0;
+  size_t iterations = 1;
+  for (int i = 2; i + 1 < argc; i += 2)
+  {
+    if (std::strcmp(argv[i], "--chunk") == 0)
+    {
+      chunk = std::strtoull(argv[i + 1], nullptr, 10);
+    }
+    else if (std::strcmp(argv[i], "--iterations") == 0)
+    {
+      iterations = std::strtoull(argv[i + 1], nullptr, 10);
+    }
+    else
+    {
+      std::cout << "unknown option " << argv[i] << std::endl;
+      return 1;
+    }
+  }
+
+  RESPCaptureReader reader;
+  if (!reader.Open(argv[1]))
+  {
+    std::cout << "can't open capture " << argv[1] << std::endl;
+    return 1;
+  }
+
+  ReplayResult result;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < iterations && result.ok; ++i)
+  {
+    Replay(reader, chunk, result);
+  }
+  auto elapsed = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - start);
+
+  if (!result.ok)
+  {
+    std::cout << "protocol error after " << result.messages << " messages"
+              << std::endl;
+    return 1;
+  }
+
+  std::cout << result.messages << " messages, " << result.bytes << " bytes in "
+            << elapsed.count() << "s\n"
+            << "  " << result.bytes / elapsed.count() / (1024 * 1024)
+            << " MiB/s, "
+            << static_cast<uint64_t>(result.messages / elapsed.count())
+            << " messages/s, " << elapsed.count() * 1e9 / result.messages
+            << " ns/message" << std::endl;
+  return 0;
+}
@@ -0,0 +1,129 @@
+#include "sha1.h"
+#include <algorithm>
+#include <cstring>
+
+static uint32_t Rol(uint32_t value, int bits)
+{
+  return (value << bits) | (value >> (32 - bits));
+}
+
+Sha1::Sha1()
+  : state_{0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0}
+  , buffer_{}
+  , length_(0)
+{
+}
+
+void Sha1::Update(std::string_view data)
+{
+  auto p = reinterpret_cast<const uint8_t*>(data.data());
+  size_t size = data.size();
+  size_t used = length_ % 64;
+  length_ += size;
+
+  if (used != 0)
+  {
+    size_t n = std::min(size, 64 - used);
+    std::memcpy(buffer_ + used, p, n);
+    p += n;
+    size -= n;
+    if (used + n < 64)
+    {
+      return;
+    }
+    Transform(buffer_);
+  }
+
+  for (; size >= 64; p += 64, size -= 64)
+  {
+    Transform(p);
+  }
+  std::memcpy(buffer_, p, size);
+}
+
+std::string Sha1::HexDigest()
+{
+  // 0x80, zeros up to 56 mod 64, then the length in bits, big-endian
+  uint64_t bits = length_ * 8;
+  uint8_t pad[72] = {0x80};
+  size_t used = length_ % 64;
+  size_t padding = used < 56 ? 56 - used : 120 - used;
+  for (int i = 0; i < 8; ++i)
+  {
+    pad[padding + i] = static_cast<uint8_t>(bits >> (56 - 8 * i));
+  }
+  Update(std::string_view(reinterpret_cast<const char*>(pad), padding + 8));
+
+  static const char digits[] = "0123456789abcdef";
+  std::string hex;
+  hex.reserve(40);
+  for (uint32_t word : state_)
+  {
+    for (int shift = 28; shift >= 0; shift -= 4)
+    {
+      hex.push_back(digits[(word >> shift) & 0xf]);
+    }
+  }
+  return hex;
+}
+
+std::string Sha1::Hex(std::string_view data)
+{
+  Sha1 sha1;
+  sha1.Update(data);
+  return sha1.HexDigest();
+}
+
+void Sha1::Transform(const uint8_t* block)
+{
+  uint32_t w[80];
+  for (int i = 0; i < 16; ++i)
+  {
+    w[i] = uint32_t(block[4 * i]) << 24 | uint32_t(block[4 * i + 1]) << 16 |
+           uint32_t(block[4 * i + 2]) << 8 | uint32_t(block[4 * i + 3]);
+  }
+  for (int i = 16; i < 80; ++i)
+  {
+    w[i] = Rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+  }
+
+  uint32_t a = state_[0], b = state_[1], c = state_[2], d = state_[3],
+           e = state_[4];
+  for (int i = 0; i < 80; ++i)
+  {
+    uint32_t f, k;
+    if (i < 20)
+    {
+      f = (b & c) | (~b & d);
+      k = 0x5a827999;
+    }
+    else if (i < 40)
+    {
+      f = b ^ c ^ d;
+      k = 0x6ed9eba1;
+    }
+    else if (i < 60)
+    {
+      f = (b & c) | (b & d) | (c & d);
+      k = 0x8f1bbcdc;
+    }
+    else
+    {
+      f = b ^ c ^ d;
+      k = 0xca62c1d6;
+    }
+
+    uint32_t t = Rol(a, 5) + f + e + k + w[i];
+    e = d;
+    d = c;
+    c = Rol(b, 30);
+    b = a;
+    a = t;
+  }
+
+  state_[0] += a;
+  state_[1] += b;
+  state_[2] += c;
+  state_[3] += d;
+  state_[4] += e;
+}
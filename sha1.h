@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// SHA-1 (FIPS 180-4). Only used to name Lua scripts the way Redis does, not
+// for anything security related.
+class Sha1
+{
+public:
+  Sha1();
+
+  void Update(std::string_view data);
+  // 40 lowercase hex digits; the object must not be updated afterwards.
+  std::string HexDigest();
+
+  static std::string Hex(std::string_view data);
+
+private:
+  void Transform(const uint8_t* block);
+
+private:
+  uint32_t state_[5];
+  uint8_t buffer_[64];
+  uint64_t length_;
+};
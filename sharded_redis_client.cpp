@@ -0,0 +1,293 @@
+#include "sharded_redis_client.h"
+#include <algorithm>
+
+struct ShardedRedisClient::Split
+{
+  Merge merge = Merge::kNone;
+  size_t pending = 0;
+  int error = RCE_SUCCESS;
+  // first error reply from a shard, or the reply for kAllOk
+  RedisMessage reply;
+  bool has_error_reply = false;
+  // kArray: for each sub-command, where its elements go in the reply
+  std::vector<std::vector<size_t>> positions;
+  RedisArray::Elements elements;
+  RedisInteger sum = 0;
+  CommandCallback callback;
+};
+
+ShardedRedisClient::ShardedRedisClient(
+  App& app, const PipelineOptions& pipeline)
+  : app_(app)
+  , pipeline_(pipeline)
+{
+}
+
+void ShardedRedisClient::AddShard(std::string_view name,
+  const asio::ip::tcp::endpoint& server, uint32_t weight)
+{
+  size_t slot = ring_.Set(name, weight);
+  if (slot == shards_.size())
+  {
+    shards_.emplace_back();
+  }
+
+  Shard& shard = shards_[slot];
+  if (shard.client && shard.server == server)
+  {
+    return;
+  }
+
+  shard.server = server;
+  shard.client = std::make_unique<RedisClient>(app_,
+    async::Bind<void(int)>(&ShardedRedisClient::OnShardConnected, this, slot),
+    async::Bind<void()>(&ShardedRedisClient::OnShardDisconnect, this, slot),
+    pipeline_);
+  shard.client->Connect(server);
+}
+
+void ShardedRedisClient::SetWeight(std::string_view name, uint32_t weight)
+{
+  size_t slot = ring_.Find(name);
+  if (slot < shards_.size() && shards_[slot].client)
+  {
+    ring_.Set(name, weight);
+  }
+}
+
+void ShardedRedisClient::RemoveShard(std::string_view name)
+{
+  size_t slot = ring_.Find(name);
+  if (slot == shards_.size())
+  {
+    return;
+  }
+
+  ring_.Remove(name);
+  // move out first: the disconnect callback must see the shard gone
+  auto client = std::move(shards_[slot].client);
+}
+
+RedisClient* ShardedRedisClient::ShardFor(std::string_view key)
+{
+  if (ring_.Empty())
+  {
+    return nullptr;
+  }
+  return shards_[ring_.Locate(key)].client.get();
+}
+
+void ShardedRedisClient::Command(
+  const std::vector<RedisArg>& args, const CommandCallback& cb_cmd)
+{
+  ++stats_.commands;
+
+  std::vector<std::string_view> views;
+  views.reserve(args.size());
+  for (const auto& arg : args)
+  {
+    views.push_back(arg.data);
+  }
+
+  std::vector<size_t> keys;
+  const RedisCommandInfo* info =
+    views.empty() ? nullptr : LookupRedisCommand(views[0]);
+  if (info == nullptr || !RedisCommandKeys(*info, views, keys) ||
+      keys.empty() || ring_.Empty())
+  {
+    ++stats_.unroutable;
+    cb_cmd.Invoke(ZResult<RedisMessage>(Failure(RCE_NOSHARD)));
+    return;
+  }
+
+  std::vector<size_t> owners;
+  owners.reserve(keys.size());
+  for (size_t key : keys)
+  {
+    owners.push_back(ring_.Locate(views[key]));
+  }
+
+  if (std::all_of(owners.begin(), owners.end(),
+        [&owners](size_t slot) { return slot == owners[0]; }))
+  {
+    shards_[owners[0]].client->Command(args, cb_cmd);
+    return;
+  }
+
+  Merge merge = MergeOf(info->name);
+  if (merge == Merge::kNone)
+  {
+    ++stats_.unroutable;
+    cb_cmd.Invoke(ZResult<RedisMessage>(Failure(RCE_CROSSSHARD)));
+    return;
+  }
+
+  ++stats_.split;
+  SplitCommand(args, *info, keys, owners, merge, cb_cmd);
+}
+
+ShardedRedisClient::Merge ShardedRedisClient::MergeOf(std::string_view name)
+{
+  if (name == "MGET")
+  {
+    return Merge::kArray;
+  }
+  if (name == "DEL" || name == "UNLINK" || name == "EXISTS" ||
+      name == "TOUCH")
+  {
+    return Merge::kSum;
+  }
+  if (name == "MSET")
+  {
+    return Merge::kAllOk;
+  }
+  return Merge::kNone;
+}
+
+void ShardedRedisClient::SplitCommand(const std::vector<RedisArg>& args,
+  const RedisCommandInfo& info, const std::vector<size_t>& keys,
+  const std::vector<size_t>& owners, Merge merge,
+  const CommandCallback& cb_cmd)
+{
+  auto split = std::make_shared<Split>();
+  split->merge = merge;
+  split->callback = cb_cmd;
+  if (merge == Merge::kArray)
+  {
+    split->elements.resize(keys.size());
+  }
+
+  // one sub-command per shard, keys (with their values) in original order
+  std::vector<size_t> slots;
+  std::vector<std::vector<RedisArg>> commands;
+  for (size_t i = 0; i < keys.size(); ++i)
+  {
+    auto it = std::find(slots.begin(), slots.end(), owners[i]);
+    size_t index = static_cast<size_t>(it - slots.begin());
+    if (it == slots.end())
+    {
+      slots.push_back(owners[i]);
+      commands.emplace_back(1, args[0]);
+      split->positions.emplace_back();
+    }
+
+    for (int j = 0; j < info.key_step; ++j)
+    {
+      commands[index].push_back(args[keys[i] + j]);
+    }
+    split->positions[index].push_back(i);
+  }
+
+  split->pending = slots.size();
+  for (size_t i = 0; i < slots.size(); ++i)
+  {
+    shards_[slots[i]].client->Command(commands[i],
+      CommandCallback([split, i](const ZResult<RedisMessage>& reply) {
+        OnSplitReply(split, i, reply);
+      }));
+  }
+}
+
+void ShardedRedisClient::OnSplitReply(const std::shared_ptr<Split>& split,
+  size_t index, const ZResult<RedisMessage>& reply)
+{
+  if (!reply)
+  {
+    if (split->error == RCE_SUCCESS)
+    {
+      split->error = reply.Error();
+    }
+  }
+  else if (std::holds_alternative<RedisError>(reply.Value()))
+  {
+    if (!split->has_error_reply)
+    {
+      split->reply = reply.Value();
+      split->has_error_reply = true;
+    }
+  }
+  else if (split->merge == Merge::kArray)
+  {
+    const RedisArray* array = std::get_if<3>(&reply.Value());
+    const RedisArray::Elements* elements =
+      array ? std::get_if<1>(&array->array) : nullptr;
+    const auto& positions = split->positions[index];
+    if (elements && elements->size() == positions.size())
+    {
+      for (size_t i = 0; i < positions.size(); ++i)
+      {
+        split->elements[positions[i]] = (*elements)[i];
+      }
+    }
+    else if (split->error == RCE_SUCCESS)
+    {
+      // slots left unfilled would read as values
+      split->error = RCE_PROTOCOL;
+    }
+  }
+  else if (split->merge == Merge::kSum)
+  {
+    if (const RedisInteger* n = std::get_if<0>(&reply.Value()))
+    {
+      split->sum += *n;
+    }
+    else if (split->error == RCE_SUCCESS)
+    {
+      split->error = RCE_PROTOCOL;
+    }
+  }
+  else if (!split->has_error_reply)
+  {
+    split->reply = reply.Value();
+  }
+
+  if (--split->pending > 0)
+  {
+    return;
+  }
+
+  if (split->error != RCE_SUCCESS)
+  {
+    split->callback.Invoke(ZResult<RedisMessage>(Failure(split->error)));
+  }
+  else if (split->has_error_reply || split->merge == Merge::kAllOk)
+  {
+    split->callback.Invoke(ZResult<RedisMessage>(Success(split->reply)));
+  }
+  else if (split->merge == Merge::kArray)
+  {
+    RedisMessage merged{
+      std::in_place_index<3>, RedisArray{std::move(split->elements)}};
+    split->callback.Invoke(ZResult<RedisMessage>(Success(merged)));
+  }
+  else
+  {
+    RedisMessage merged{std::in_place_index<0>, split->sum};
+    split->callback.Invoke(ZResult<RedisMessage>(Success(merged)));
+  }
+}
+
+void ShardedRedisClient::OnShardConnected(size_t slot, int error)
+{
+  if (error)
+  {
+    OnShardDisconnect(slot);
+  }
+}
+
+void ShardedRedisClient::OnShardDisconnect(size_t slot)
+{
+  // pending commands already failed; retry the connection shortly
+  app_.AddOneshotTimer(std::chrono::seconds{1},
+    async::Bind<void(TickTimerID)>(
+      &ShardedRedisClient::OnReconnectTimer, this, slot));
+}
+
+void ShardedRedisClient::OnReconnectTimer(size_t slot, TickTimerID timer_id)
+{
+  Shard& shard = shards_[slot];
+  if (shard.client)
+  {
+    shard.client->Connect(shard.server);
+  }
+}
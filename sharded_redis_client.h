@@ -0,0 +1,93 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "app.h"
+#include "callback.h"
+#include "hash_ring.h"
+#include "redis_client.h"
+#include "redis_command.h"
+#include "thirtyparty/asio/asio.hpp"
+
+// the command has no key to route on, or no shard is on the ring
+#define RCE_NOSHARD 4
+// the keys span shards and the command cannot be split
+#define RCE_CROSSSHARD 5
+
+struct ShardedRedisClientStats
+{
+  uint64_t commands = 0;
+  // commands split over several shards
+  uint64_t split = 0;
+  uint64_t unroutable = 0;
+};
+
+// Client over a fleet of standalone Redis nodes, sharding keys with a
+// consistent hash ring. Single-key commands, and multi-key commands whose
+// keys land on one shard (see HashRing::HashTag), go to that shard as they
+// are. MGET, MSET, DEL, UNLINK, EXISTS and TOUCH spanning shards are split
+// into one command per shard and the replies merged, failing with
+// RCE_PROTOCOL if a shard's reply does not match its part; other commands
+// spanning shards fail with RCE_CROSSSHARD.
+class ShardedRedisClient : public async::CallbackHost
+{
+public:
+  ShardedRedisClient(
+    App& app, const PipelineOptions& pipeline = PipelineOptions{});
+
+  // Add a shard and connect it, or change the weight of an existing one.
+  // Weight 0 takes it off the ring but keeps the connection, to let its
+  // pending commands finish before RemoveShard.
+  void AddShard(std::string_view name, const asio::ip::tcp::endpoint& server,
+    uint32_t weight = 1);
+  void SetWeight(std::string_view name, uint32_t weight);
+  // Close the shard's connection, failing its pending commands.
+  void RemoveShard(std::string_view name);
+
+  void Command(
+    const std::vector<RedisArg>& args, const CommandCallback& cb_cmd);
+
+  // Client owning key, nullptr if there is no shard.
+  RedisClient* ShardFor(std::string_view key);
+
+  ShardedRedisClientStats Stats() const { return stats_; }
+
+private:
+  struct Shard
+  {
+    asio::ip::tcp::endpoint server;
+    std::unique_ptr<RedisClient> client;
+  };
+
+  enum class Merge
+  {
+    kNone,
+    kArray,
+    kSum,
+    kAllOk,
+  };
+
+  struct Split;
+
+  static Merge MergeOf(std::string_view name);
+  void SplitCommand(const std::vector<RedisArg>& args,
+    const RedisCommandInfo& info, const std::vector<size_t>& keys,
+    const std::vector<size_t>& owners, Merge merge,
+    const CommandCallback& cb_cmd);
+  static void OnSplitReply(const std::shared_ptr<Split>& split,
+    size_t shard, const ZResult<RedisMessage>& reply);
+
+  void OnShardConnected(size_t slot, int error);
+  void OnShardDisconnect(size_t slot);
+  void OnReconnectTimer(size_t slot, TickTimerID timer_id);
+
+private:
+  App& app_;
+  PipelineOptions pipeline_;
+  HashRing ring_;
+  // indexed by ring slot; removed shards leave an empty client
+  std::vector<Shard> shards_;
+  ShardedRedisClientStats stats_;
+};
@@ -0,0 +1,202 @@
+#include "spill_log.h"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <filesystem>
+#include <vector>
+
+#define RECORD_HEADER_SIZE sizeof(uint32_t)
+
+static uint32_t ReadLength(const char* p)
+{
+  uint32_t len;
+  std::memcpy(&len, p, sizeof(len));
+  return len;
+}
+
+SpillLog::SpillLog(const SpillOptions& options)
+  : options_(options)
+  , next_seq_(0)
+  , records_(0)
+  , bytes_(0)
+{
+  std::filesystem::create_directories(options_.dir);
+  Recover();
+}
+
+SpillLog::~SpillLog()
+{
+  if (options_.sync != SpillSyncPolicy::kNone && !segments_.empty())
+  {
+    segments_.back()->file.Sync();
+  }
+}
+
+bool SpillLog::Append(std::string_view record)
+{
+  size_t need = RECORD_HEADER_SIZE + record.size();
+  if (record.empty() || need > options_.segment_size)
+  {
+    return false;
+  }
+
+  if (segments_.empty() ||
+      segments_.back()->write_pos + need > segments_.back()->file.Size())
+  {
+    if (!Rotate())
+    {
+      return false;
+    }
+  }
+
+  Segment& tail = *segments_.back();
+  char* p = tail.file.Data() + tail.write_pos;
+  // payload first, length last: a torn append reads as the end of data
+  std::memcpy(p + RECORD_HEADER_SIZE, record.data(), record.size());
+  uint32_t len = static_cast<uint32_t>(record.size());
+  std::memcpy(p, &len, sizeof(len));
+  tail.write_pos += need;
+
+  ++records_;
+  bytes_ += need;
+
+  if (options_.sync == SpillSyncPolicy::kAlways)
+  {
+    tail.file.Sync();
+  }
+  return true;
+}
+
+std::string_view SpillLog::Front() const
+{
+  const Segment& head = *segments_.front();
+  const char* p = head.file.Data() + head.read_pos;
+  return {p + RECORD_HEADER_SIZE, ReadLength(p)};
+}
+
+void SpillLog::Pop()
+{
+  Segment& head = *segments_.front();
+  size_t len = RECORD_HEADER_SIZE + ReadLength(head.file.Data() + head.read_pos);
+  head.read_pos += len;
+  --records_;
+  bytes_ -= len;
+
+  // the tail segment stays, it is still being appended to
+  if (head.read_pos == head.write_pos && segments_.size() > 1)
+  {
+    RemoveFront();
+  }
+}
+
+bool SpillLog::Rotate()
+{
+  if (segments_.size() == 1 &&
+      segments_.front()->read_pos == segments_.front()->write_pos)
+  {
+    // fully drained, nothing left to keep it for
+    RemoveFront();
+  }
+
+  if ((segments_.size() + 1) * options_.segment_size > options_.max_bytes)
+  {
+    return false;
+  }
+
+  if (!segments_.empty() && options_.sync == SpillSyncPolicy::kSegment)
+  {
+    segments_.back()->file.Sync();
+  }
+
+  auto segment = std::make_unique<Segment>();
+  segment->seq = next_seq_;
+  if (!segment->file.Open(SegmentPath(segment->seq), options_.segment_size))
+  {
+    return false;
+  }
+
+  ++next_seq_;
+  segments_.push_back(std::move(segment));
+  return true;
+}
+
+void SpillLog::RemoveFront()
+{
+  std::string path = segments_.front()->file.Path();
+  segments_.pop_front();
+
+  std::error_code ec;
+  std::filesystem::remove(path, ec);
+}
+
+void SpillLog::Recover()
+{
+  std::vector<uint64_t> seqs;
+  std::error_code ec;
+  for (const auto& entry : std::filesystem::directory_iterator(options_.dir, ec))
+  {
+    std::string name = entry.path().filename().string();
+    if (name.size() <= 10 || name.compare(0, 6, "spill.") != 0 ||
+        name.compare(name.size() - 4, 4, ".log") != 0)
+    {
+      continue;
+    }
+
+    // not one of ours if the middle is not a sequence number
+    uint64_t seq = 0;
+    const char* first = name.data() + 6;
+    const char* last = name.data() + name.size() - 4;
+    auto [ptr, parse_ec] = std::from_chars(first, last, seq);
+    if (parse_ec != std::errc{} || ptr != last)
+    {
+      continue;
+    }
+    seqs.push_back(seq);
+  }
+  std::sort(seqs.begin(), seqs.end());
+
+  for (uint64_t seq : seqs)
+  {
+    auto segment = std::make_unique<Segment>();
+    segment->seq = seq;
+    next_seq_ = seq + 1;
+    if (!segment->file.Open(SegmentPath(seq), options_.segment_size))
+    {
+      continue;
+    }
+
+    // find the end of the written records
+    const char* data = segment->file.Data();
+    size_t size = segment->file.Size();
+    size_t pos = 0;
+    while (pos + RECORD_HEADER_SIZE <= size)
+    {
+      uint32_t len = ReadLength(data + pos);
+      if (len == 0 || pos + RECORD_HEADER_SIZE + len > size)
+      {
+        break;
+      }
+
+      pos += RECORD_HEADER_SIZE + len;
+      ++records_;
+    }
+
+    if (pos == 0)
+    {
+      segment->file.Close();
+      std::filesystem::remove(SegmentPath(seq), ec);
+      continue;
+    }
+
+    segment->write_pos = pos;
+    bytes_ += pos;
+    segments_.push_back(std::move(segment));
+  }
+}
+
+std::string SpillLog::SegmentPath(uint64_t seq) const
+{
+  return (std::filesystem::path(options_.dir) /
+          ("spill." + std::to_string(seq) + ".log"))
+    .string();
+}
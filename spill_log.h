@@ -0,0 +1,74 @@
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include "mapped_file.h"
+
+enum class SpillSyncPolicy
+{
+  kNone,     // leave write-back to the OS
+  kSegment,  // sync a segment when it is sealed
+  kAlways,   // sync after every append
+};
+
+struct SpillOptions
+{
+  std::string dir;
+  size_t segment_size = 64 * 1024 * 1024;
+  // cap on the disk space of all segments
+  size_t max_bytes = 1024 * 1024 * 1024;
+  SpillSyncPolicy sync = SpillSyncPolicy::kSegment;
+  // RedisClient::Send spills while this many commands are queued
+  size_t queue_limit = 64 * 1024;
+  // records moved back into the command queue per drain
+  size_t drain_batch = 1024;
+};
+
+// Append-only FIFO of records kept in memory-mapped segment files
+// <dir>/spill.<seq>.log. A record is a 32-bit length followed by the
+// payload; a zero length marks the end of the written part of a segment.
+// Segments left by a previous process are picked up again on construction,
+// so records consumed but not yet deleted may be delivered twice.
+class SpillLog
+{
+public:
+  explicit SpillLog(const SpillOptions& options);
+  ~SpillLog();
+
+  // Returns false when the record does not fit under max_bytes or the
+  // segment file cannot be created, which includes the disk having no
+  // room for a whole segment.
+  bool Append(std::string_view record);
+
+  // Oldest record; only valid while Empty() is false.
+  std::string_view Front() const;
+  void Pop();
+
+  bool Empty() const { return records_ == 0; }
+  size_t Records() const { return records_; }
+  size_t Bytes() const { return bytes_; }
+  const SpillOptions& Options() const { return options_; }
+
+private:
+  struct Segment
+  {
+    uint64_t seq = 0;
+    MappedFile file;
+    size_t read_pos = 0;
+    size_t write_pos = 0;
+  };
+
+  void Recover();
+  bool Rotate();
+  void RemoveFront();
+  std::string SegmentPath(uint64_t seq) const;
+
+private:
+  SpillOptions options_;
+  std::deque<std::unique_ptr<Segment>> segments_;
+  uint64_t next_seq_;
+  size_t records_;
+  size_t bytes_;
+};